@@ -4,15 +4,16 @@
 #include "OBBVolume.h"
 #include "SphereVolume.h"
 #include "../../Common/Vector2.h"
-#include "../../Common/Window.h"
 #include "../../Common/Maths.h"
 #include "../../Common/Plane.h"
-#include "Debug.h"
 
 #include <list>
 
 using namespace NCL;
 
+// How close to running along a capsule (as a fraction of its length, squared) a ray can be before it's treated as parallel
+static const float capsuleParallelEpsilon = 1e-6f;
+
 bool CollisionDetection::RayPlaneIntersection(const Ray&r, const Plane&p, RayCollision& collisions) {
 	float ln = Vector3::Dot(p.GetNormal(), r.GetDirection());
 
@@ -51,39 +52,37 @@ bool CollisionDetection::RayIntersection(const Ray& r,GameObject& object, RayCol
 	return hasCollided;
 }
 
-//	Raybox can be used for both AABB and OBB
+/*
+	Raybox can be used for both AABB and OBB. It's the slab test - the ray is
+	inside the box between the last of the three pairs of planes it enters and
+	the first it leaves, so if it leaves one before entering another, it missed.
+*/
 bool CollisionDetection::RayBoxIntersection(const Ray&r, const Vector3& boxPos, const Vector3& boxSize, RayCollision& collision) {
-	Vector3 boxMin = boxPos - boxSize;
-	Vector3 boxMax = boxPos + boxSize;
-	
 	Vector3 rayPos = r.GetPosition();
 	Vector3 rayDir = r.GetDirection();
-	
-	Vector3 tVals(-1, -1, -1);
-	
-	for (int i = 0; i < 3; ++i) { // get best 3 intersections
-		if (rayDir[i] > 0) {
-			tVals[i] = (boxMin[i] - rayPos[i]) / rayDir[i];
-		}
-		else if (rayDir[i] < 0) {
-			tVals[i] = (boxMax[i] - rayPos[i]) / rayDir[i];
-		}	
-	}
-	float bestT = tVals.GetMaxElement();
-	if (bestT < 0.0f) {
-		return false; // no backwards rays !
-	}
 
-	Vector3 intersection = rayPos + (rayDir * bestT);
-	const float epsilon = 0.0001f; // an amount of leeway in our calcs
-	for (int i = 0; i < 3; ++i) { // iterate over each access, working out whether the intersection point is too far to one side or the other
-		if (intersection[i] + epsilon < boxMin[i] ||
-			intersection[i] - epsilon > boxMax[i]) {
-			return false; // best intersection doesnt touch the box !
+	float tEnter	= -FLT_MAX;
+	float tExit		= FLT_MAX;
+	for (int i = 0; i < 3; ++i) {
+		float boxMin = boxPos[i] - boxSize[i];
+		float boxMax = boxPos[i] + boxSize[i];
+		if (rayDir[i] == 0.0f) {
+			if (rayPos[i] < boxMin || rayPos[i] > boxMax) {
+				return false; // running alongside the box, but outside it
+			}
+			continue;
 		}
+		float inverse	= 1.0f / rayDir[i];
+		float t0		= (boxMin - rayPos[i]) * inverse;
+		float t1		= (boxMax - rayPos[i]) * inverse;
+		tEnter	= std::max(tEnter, std::min(t0, t1));
+		tExit	= std::min(tExit, std::max(t0, t1));
+	}
+	if (tEnter < 0.0f || tEnter > tExit) {
+		return false; // no backwards rays, or rays from inside the box !
 	}
-	collision.collidedAt = intersection;
-	collision.rayDistance = bestT;
+	collision.collidedAt	= rayPos + (rayDir * tEnter);
+	collision.rayDistance	= tEnter;
 	
 	return true;
 }
@@ -94,51 +93,70 @@ bool CollisionDetection::RayAABBIntersection(const Ray&r, const Transform& world
 	return RayBoxIntersection(r, boxPos, boxSize, collision);
 }
 
+// Turning the ray into the box's space is just the same as turning the box to line up with the axes
 bool CollisionDetection::RayOBBIntersection(const Ray&r, const Transform& worldTransform, const OBBVolume& volume, RayCollision& collision) {
-	Quaternion orientation = worldTransform.GetOrientation();
-	Vector3 position = worldTransform.GetPosition();
+	RigidTransform transform(worldTransform.GetPosition(), worldTransform.GetOrientation());
 	
-	Matrix3 transform = Matrix3(orientation);
-	Matrix3 invTransform = Matrix3(orientation.Conjugate());
-	
-	Vector3 localRayPos = r.GetPosition() - position;
-	
-	Ray tempRay(invTransform * localRayPos, invTransform * r.GetDirection());
+	Ray tempRay(transform.InverseTransformPoint(r.GetPosition()), transform.InverseTransformDirection(r.GetDirection()));
 	
 	bool collided = RayBoxIntersection(tempRay, Vector3(), volume.GetHalfDimensions(), collision);
 	
 	if (collided) {
-		collision.collidedAt = transform * collision.collidedAt + position;
+		collision.collidedAt = transform.TransformPoint(collision.collidedAt);
 	}
 	
 	return collided;
 }
 
-// Using Ray-Plane to get some coordinates for where the ray has hit the capsule - then place a sphere and do Ray-Sphere on it
+/*
+	Solves for where the ray meets the infinite cylinder around the capsule's
+	line first. If that's between the two ends, that's the hit - otherwise the
+	ray can only hit the sphere capping whichever end it was past. The ray's
+	direction has to be normalised.
+*/
 bool CollisionDetection::RayCapsuleIntersection(const Ray& r, const Transform& worldTransform, const CapsuleVolume& volume, RayCollision& collision) {
-	Vector3 firstPoint = worldTransform.GetPosition() + (worldTransform.GetOrientation() * (Vector3(0, 1, 0) * (volume.GetHalfHeight() - volume.GetRadius())));
-	Vector3 secondPoint = worldTransform.GetPosition() - (worldTransform.GetOrientation() * (Vector3(0, 1, 0) * (volume.GetHalfHeight() - volume.GetRadius())));
+	float radius	= volume.GetRadius();
+	Vector3 axis	= worldTransform.GetOrientation() * Vector3(0, volume.GetHalfHeight() - radius, 0);
+	Vector3 bottom	= worldTransform.GetPosition() - axis;
+	Vector3 top		= worldTransform.GetPosition() + axis;
 
-	// Cross product between the capsules center and the normal
-	Vector3 c = Vector3::Cross(worldTransform.GetPosition(), r.GetPosition() - worldTransform.GetPosition());
-	Vector3 thirdPoint = worldTransform.GetPosition() + c.Normalised();
-
-	Plane p = Plane::PlaneFromTri(firstPoint, secondPoint, thirdPoint);
-	if (!RayPlaneIntersection(r, p, collision)) return false;
-
-	Vector3 capsuleDirection = firstPoint - secondPoint;
-	float capsuleLength = capsuleDirection.Length();
-	capsuleDirection.Normalise();
-
-	Vector3 rayCapDirection = collision.collidedAt - secondPoint;
-	float dotProd = Maths::Clamp(Vector3::Dot(rayCapDirection, capsuleDirection), 0.0f, capsuleLength);
+	Vector3 rayPos = r.GetPosition();
+	Vector3 rayDir = r.GetDirection();
 
-	// Create sphere for Ray-Sphere check
-	SphereVolume sphere(volume.GetRadius());
-	Transform sphereTransform;
-	sphereTransform.SetPosition(secondPoint + (capsuleDirection * dotProd));
-	sphereTransform.SetScale(Vector3(volume.GetRadius(), volume.GetRadius(), volume.GetRadius()));
-	return RaySphereIntersection(r, sphereTransform, sphere, collision);
+	Vector3 ba = top - bottom;
+	Vector3 oa = rayPos - bottom;
+	float baba = Vector3::Dot(ba, ba);
+	float bard = Vector3::Dot(ba, rayDir);
+	float baoa = Vector3::Dot(ba, oa);
+
+	float t = 0.0f;
+	float y = (bard > 0.0f) ? 0.0f : baba; // a ray running along the capsule can only hit the end it's heading towards first
+	float a = baba - (bard * bard);
+	if (a > capsuleParallelEpsilon * baba) {
+		float b = (baba * Vector3::Dot(rayDir, oa)) - (baoa * bard);
+		float c = (baba * Vector3::Dot(oa, oa)) - (baoa * baoa) - (radius * radius * baba);
+		float h = (b * b) - (a * c);
+		if (h < 0.0f) {
+			return false; // missed the cylinder, so it misses the ends inside it too
+		}
+		t = (-b - sqrt(h)) / a;
+		y = baoa + (t * bard);
+	}
+	if (y <= 0.0f || y >= baba) {
+		Vector3 oc	= (y <= 0.0f) ? oa : rayPos - top;
+		float b		= Vector3::Dot(rayDir, oc);
+		float h		= (b * b) - (Vector3::Dot(oc, oc) - (radius * radius));
+		if (h < 0.0f) {
+			return false;
+		}
+		t = -b - sqrt(h);
+	}
+	if (t < 0.0f) {
+		return false; // no backwards rays !
+	}
+	collision.rayDistance	= t;
+	collision.collidedAt	= rayPos + (rayDir * t);
+	return true;
 }
 
 bool CollisionDetection::RaySphereIntersection(const Ray&r, const Transform& worldTransform, const SphereVolume& volume, RayCollision& collision) {
@@ -172,31 +190,171 @@ bool CollisionDetection::RaySphereIntersection(const Ray&r, const Transform& wor
 	return true;
 }
 
-Matrix4 GenerateInverseView(const Camera &c) {
-	float pitch = c.GetPitch();
-	float yaw	= c.GetYaw();
-	Vector3 position = c.GetPosition();
+int CollisionDetection::RayPacketIntersection(const RayPacket& rays, GameObject& object, float distances[4]) {
+	const Transform& worldTransform = object.GetTransform();
+	const CollisionVolume* volume	= object.GetBoundingVolume();
+
+	if (!volume) {
+		return 0;
+	}
+
+	SIMD::Float4 hitDistances;
+	int hits = 0;
+	switch (volume->type) {
+		case VolumeType::AABB:		hits = RayPacketAABBIntersection(rays, worldTransform, (const AABBVolume&)*volume, hitDistances); break;
+		case VolumeType::OBB:		hits = RayPacketOBBIntersection(rays, worldTransform, (const OBBVolume&)*volume, hitDistances); break;
+		case VolumeType::Sphere:	hits = RayPacketSphereIntersection(rays, worldTransform, (const SphereVolume&)*volume, hitDistances); break;
+		case VolumeType::Capsule:	hits = RayPacketCapsuleIntersection(rays, worldTransform, (const CapsuleVolume&)*volume, hitDistances); break;
+		default: return 0;
+	}
+	SIMD::Store(distances, hitDistances);
+	return hits;
+}
+
+int CollisionDetection::RayPacketBoxIntersection(const RayPacket& rays, const Vector3& boxPos, const Vector3& boxSize, SIMD::Float4& distances) {
+	using namespace SIMD;
+	const Float4 zero	= Splat(0.0f);
+	const Float4* origins[3]	= { &rays.originX, &rays.originY, &rays.originZ };
+	const Float4* directions[3] = { &rays.directionX, &rays.directionY, &rays.directionZ };
+
+	Float4 tEnter	= Splat(-FLT_MAX);
+	Float4 tExit	= Splat(FLT_MAX);
+	Float4 missed	= zero;
+	for (int i = 0; i < 3; ++i) {
+		Float4 boxMin	= Splat(boxPos[i] - boxSize[i]);
+		Float4 boxMax	= Splat(boxPos[i] + boxSize[i]);
+		Float4 o		= *origins[i];
+		Float4 d		= *directions[i];
+
+		// rays running alongside a pair of planes either miss, or aren't limited by them at all
+		Float4 parallel = Equal(d, zero);
+		missed = Or(missed, And(parallel, Or(Less(o, boxMin), Less(boxMax, o))));
+
+		Float4 inverse	= Div(Splat(1.0f), Select(parallel, Splat(1.0f), d));
+		Float4 t0		= Mul(Sub(boxMin, o), inverse);
+		Float4 t1		= Mul(Sub(boxMax, o), inverse);
+		tEnter	= Max(tEnter, Select(parallel, Splat(-FLT_MAX), Min(t0, t1)));
+		tExit	= Min(tExit, Select(parallel, Splat(FLT_MAX), Max(t0, t1)));
+	}
+	Float4 hit = And(LessEqual(zero, tEnter), LessEqual(tEnter, tExit));
+	hit = Select(missed, zero, hit);
+
+	distances = Select(hit, tEnter, Splat(FLT_MAX));
+	return Mask(hit);
+}
 
-	Matrix4 iview =
-		Matrix4::Translation(position) *
-		Matrix4::Rotation(-yaw, Vector3(0, -1, 0)) *
-		Matrix4::Rotation(-pitch, Vector3(-1, 0, 0));
+int CollisionDetection::RayPacketAABBIntersection(const RayPacket& rays, const Transform& worldTransform, const AABBVolume& volume, SIMD::Float4& distances) {
+	return RayPacketBoxIntersection(rays, worldTransform.GetPosition(), volume.GetHalfDimensions(), distances);
+}
 
-	return iview;
+int CollisionDetection::RayPacketOBBIntersection(const RayPacket& rays, const Transform& worldTransform, const OBBVolume& volume, SIMD::Float4& distances) {
+	using namespace SIMD;
+	// built once for all four rays - its rotation's columns are the rows of the inverse rotation
+	RigidTransform transform(worldTransform.GetPosition(), worldTransform.GetOrientation());
+	Vector3 position	= transform.GetPosition();
+	const float* m		= transform.GetRotation().array;
+
+	Float4 x = Sub(rays.originX, Splat(position.x));
+	Float4 y = Sub(rays.originY, Splat(position.y));
+	Float4 z = Sub(rays.originZ, Splat(position.z));
+
+	RayPacket localRays;
+	localRays.originX		= MulAdd(z, Splat(m[2]), MulAdd(y, Splat(m[1]), Mul(x, Splat(m[0]))));
+	localRays.originY		= MulAdd(z, Splat(m[5]), MulAdd(y, Splat(m[4]), Mul(x, Splat(m[3]))));
+	localRays.originZ		= MulAdd(z, Splat(m[8]), MulAdd(y, Splat(m[7]), Mul(x, Splat(m[6]))));
+	localRays.directionX	= MulAdd(rays.directionZ, Splat(m[2]), MulAdd(rays.directionY, Splat(m[1]), Mul(rays.directionX, Splat(m[0]))));
+	localRays.directionY	= MulAdd(rays.directionZ, Splat(m[5]), MulAdd(rays.directionY, Splat(m[4]), Mul(rays.directionX, Splat(m[3]))));
+	localRays.directionZ	= MulAdd(rays.directionZ, Splat(m[8]), MulAdd(rays.directionY, Splat(m[7]), Mul(rays.directionX, Splat(m[6]))));
+
+	return RayPacketBoxIntersection(localRays, Vector3(), volume.GetHalfDimensions(), distances);
 }
 
-Vector3 CollisionDetection::Unproject(const Vector3& screenPos, const Camera& cam) {
-	Vector2 screenSize = Window::GetWindow()->GetScreenSize();
+int CollisionDetection::RayPacketSphereIntersection(const RayPacket& rays, const Transform& worldTransform, const SphereVolume& volume, SIMD::Float4& distances) {
+	using namespace SIMD;
+	const Float4 zero	= Splat(0.0f);
+	Vector3 spherePos	= worldTransform.GetPosition();
+	Float4 radiusSq		= Splat(volume.GetRadius() * volume.GetRadius());
+
+	Float4 dirX = Sub(Splat(spherePos.x), rays.originX);
+	Float4 dirY = Sub(Splat(spherePos.y), rays.originY);
+	Float4 dirZ = Sub(Splat(spherePos.z), rays.originZ);
 
+	Float4 sphereProj	= MulAdd(dirZ, rays.directionZ, MulAdd(dirY, rays.directionY, Mul(dirX, rays.directionX)));
+
+	// How far the closest point on each ray is from the sphere's centre
+	Float4 offsetX		= Sub(Mul(rays.directionX, sphereProj), dirX);
+	Float4 offsetY		= Sub(Mul(rays.directionY, sphereProj), dirY);
+	Float4 offsetZ		= Sub(Mul(rays.directionZ, sphereProj), dirZ);
+	Float4 sphereDistSq = MulAdd(offsetZ, offsetZ, MulAdd(offsetY, offsetY, Mul(offsetX, offsetX)));
+
+	Float4 hit = And(LessEqual(zero, sphereProj), LessEqual(sphereDistSq, radiusSq));
+	Float4 offset = Sqrt(Max(Sub(radiusSq, sphereDistSq), zero));
+
+	distances = Select(hit, Sub(sphereProj, offset), Splat(FLT_MAX));
+	return Mask(hit);
+}
+
+int CollisionDetection::RayPacketCapsuleIntersection(const RayPacket& rays, const Transform& worldTransform, const CapsuleVolume& volume, SIMD::Float4& distances) {
+	using namespace SIMD;
+	const Float4 zero	= Splat(0.0f);
+	const Float4 one	= Splat(1.0f);
+	float radius	= volume.GetRadius();
+	Vector3 axis	= worldTransform.GetOrientation() * Vector3(0, volume.GetHalfHeight() - radius, 0);
+	Vector3 bottom	= worldTransform.GetPosition() - axis;
+	Vector3 top		= worldTransform.GetPosition() + axis;
+	Vector3 ba		= top - bottom;
+	float	baba	= Vector3::Dot(ba, ba);
+	Float4 radiusSq = Splat(radius * radius);
+
+	auto dot = [](Float4 ax, Float4 ay, Float4 az, Float4 bx, Float4 by, Float4 bz) {
+		return MulAdd(az, bz, MulAdd(ay, by, Mul(ax, bx)));
+	};
+
+	Float4 oaX = Sub(rays.originX, Splat(bottom.x));
+	Float4 oaY = Sub(rays.originY, Splat(bottom.y));
+	Float4 oaZ = Sub(rays.originZ, Splat(bottom.z));
+
+	Float4 babaV	= Splat(baba);
+	Float4 bard		= dot(Splat(ba.x), Splat(ba.y), Splat(ba.z), rays.directionX, rays.directionY, rays.directionZ);
+	Float4 baoa		= dot(Splat(ba.x), Splat(ba.y), Splat(ba.z), oaX, oaY, oaZ);
+	Float4 rdoa		= dot(rays.directionX, rays.directionY, rays.directionZ, oaX, oaY, oaZ);
+	Float4 oaoa		= dot(oaX, oaY, oaZ, oaX, oaY, oaZ);
+
+	// The infinite cylinder, for every ray that isn't running along it
+	Float4 a		= Sub(babaV, Mul(bard, bard));
+	Float4 crossing = Less(Splat(capsuleParallelEpsilon * baba), a);
+	Float4 b		= Sub(Mul(babaV, rdoa), Mul(baoa, bard));
+	Float4 c		= Sub(Sub(Mul(babaV, oaoa), Mul(baoa, baoa)), Mul(radiusSq, babaV));
+	Float4 h		= Sub(Mul(b, b), Mul(Select(crossing, a, zero), c));
+	Float4 missed	= And(crossing, Less(h, zero));
+	Float4 t		= Div(Sub(Sub(zero, b), Sqrt(Max(h, zero))), Select(crossing, a, one));
+	Float4 y		= Select(crossing, MulAdd(t, bard, baoa), Select(Less(zero, bard), zero, babaV));
+	Float4 side		= And(crossing, And(Less(zero, y), Less(y, babaV)));
+
+	// Everything else can only hit the sphere on the end it was past
+	Float4 nearBottom = LessEqual(y, zero);
+	Float4 ocX	= Select(nearBottom, oaX, Sub(rays.originX, Splat(top.x)));
+	Float4 ocY	= Select(nearBottom, oaY, Sub(rays.originY, Splat(top.y)));
+	Float4 ocZ	= Select(nearBottom, oaZ, Sub(rays.originZ, Splat(top.z)));
+	Float4 capB = dot(rays.directionX, rays.directionY, rays.directionZ, ocX, ocY, ocZ);
+	Float4 capH = Sub(Mul(capB, capB), Sub(dot(ocX, ocY, ocZ, ocX, ocY, ocZ), radiusSq));
+	Float4 capT = Sub(Sub(zero, capB), Sqrt(Max(capH, zero)));
+
+	t = Select(side, t, capT);
+	Float4 hit = Select(side, Equal(zero, zero), LessEqual(zero, capH));
+	hit = And(hit, LessEqual(zero, t));
+	hit = Select(missed, zero, hit);
+
+	distances = Select(hit, t, Splat(FLT_MAX));
+	return Mask(hit);
+}
+
+Vector3 CollisionDetection::Unproject(const Vector3& screenPos, const Camera& cam, const Vector2& screenSize) {
 	float aspect	= screenSize.x / screenSize.y;
 	float fov		= cam.GetFieldOfVision();
 	float nearPlane = cam.GetNearPlane();
 	float farPlane  = cam.GetFarPlane();
 
-	/*	Create our inverted matrix! Note how that to get a correct inverse matrix,
-		the order of matrices used to form it are inverted, too. */
-	Matrix4 invVP = GenerateInverseView(cam) * GenerateInverseProjection(aspect, fov, nearPlane, farPlane);
-
 	/*	Our mouse position x and y values are in 0 to screen dimensions range,
 		so we need to turn them into the -1 to 1 axis range of clip space.
 		We can do that by dividing the mouse values by the width and height of the
@@ -209,17 +367,17 @@ Vector3 CollisionDetection::Unproject(const Vector3& screenPos, const Camera& ca
 		1.0f
 	);
 
-	//	Then, we multiply our clipspace coordinate by our inverted matrix
-	Vector4 transformed = invVP * clipSpace;
+	/*	Then, we undo the projection, to get back into view space. Our transformed
+		w coordinate is now the 'inverse' perspective divide, so we can reconstruct
+		the view space position by dividing x,y,and z by w. */
+	Vector4 transformed = GenerateInverseProjection(aspect, fov, nearPlane, farPlane) * clipSpace;
+	Vector3 viewPos = Vector3(transformed.x / transformed.w, transformed.y / transformed.w, transformed.z / transformed.w);
 
-	/*	our transformed w coordinate is now the 'inverse' perspective divide, so
-		we can reconstruct the final world space by dividing x,y,and z by w. */
-	return Vector3(transformed.x / transformed.w, transformed.y / transformed.w, transformed.z / transformed.w);
+	//	The view matrix is only a rotation and a translation, so undoing it is cheap
+	return GenerateInverseViewTransform(cam).TransformPoint(viewPos);
 }
 
-Ray CollisionDetection::BuildRayFromMouse(const Camera& cam) {
-	Vector2 screenMouse = Window::GetMouse()->GetAbsolutePosition();
-	Vector2 screenSize	= Window::GetWindow()->GetScreenSize();
+Ray CollisionDetection::BuildRayFromMouse(const Camera& cam, const Vector2& screenMouse, const Vector2& screenSize) {
 
 	/*	We remove the y axis mouse position from height as OpenGL is 'upside down',
 		and thinks the bottom left is the origin, instead of the top left! */
@@ -235,8 +393,8 @@ Ray CollisionDetection::BuildRayFromMouse(const Camera& cam) {
 		0.99999f
 	);
 
-	Vector3 a = Unproject(nearPos, cam);
-	Vector3 b = Unproject(farPos, cam);
+	Vector3 a = Unproject(nearPos, cam, screenSize);
+	Vector3 b = Unproject(farPos, cam, screenSize);
 	Vector3 c = b - a;
 
 	c.Normalise();
@@ -273,16 +431,15 @@ Matrix4 CollisionDetection::GenerateInverseProjection(float aspect, float fov, f
 
 // Generating an inverse view matrix, pretty much an exact inversion of the BuildViewMatrix function of the Camera class
 Matrix4 CollisionDetection::GenerateInverseView(const Camera &c) {
-	float pitch = c.GetPitch();
-	float yaw	= c.GetYaw();
-	Vector3 position = c.GetPosition();
+	return GenerateInverseViewTransform(c).ToMatrix4();
+}
 
-	Matrix4 iview =
-		Matrix4::Translation(position) *
-		Matrix4::Rotation(yaw, Vector3(0, 1, 0)) *
-		Matrix4::Rotation(pitch, Vector3(1, 0, 0));
+RigidTransform CollisionDetection::GenerateInverseViewTransform(const Camera &c) {
+	Matrix3 rotation =
+		Matrix3::Rotation(c.GetYaw(), Vector3(0, 1, 0)) *
+		Matrix3::Rotation(c.GetPitch(), Vector3(1, 0, 0));
 
-	return iview;
+	return RigidTransform(c.GetPosition(), rotation);
 }
 
 
@@ -295,13 +452,7 @@ Matrix4 CollisionDetection::GenerateInverseView(const Camera &c) {
 	and fov used to create the projection matrix of our scene, and the camera used to 
 	form the view matrix.
 */
-Vector3	CollisionDetection::UnprojectScreenPosition(Vector3 position, float aspect, float fov, const Camera &c) {
-	/*	Create our inverted matrix! Note how that to get a correct inverse matrix,
-		the order of matrices used to form it are inverted, too. */
-	Matrix4 invVP = GenerateInverseView(c) * GenerateInverseProjection(aspect, fov, c.GetNearPlane(), c.GetFarPlane());
-
-	Vector2 screenSize = Window::GetWindow()->GetScreenSize();
-
+Vector3	CollisionDetection::UnprojectScreenPosition(Vector3 position, float aspect, float fov, const Camera &c, const Vector2& screenSize) {
 	/*	Our mouse position x and y values are in 0 to screen dimensions range,
 		so we need to turn them into the -1 to 1 axis range of clip space.
 		We can do that by dividing the mouse values by the width and height of the
@@ -314,12 +465,14 @@ Vector3	CollisionDetection::UnprojectScreenPosition(Vector3 position, float aspe
 		1.0f
 	);
 
-	//	Then, we multiply our clipspace coordinate by our inverted matrix
-	Vector4 transformed = invVP * clipSpace;
+	/*	Then, we undo the projection, to get back into view space. Our transformed
+		w coordinate is now the 'inverse' perspective divide, so we can reconstruct
+		the view space position by dividing x,y,and z by w. */
+	Vector4 transformed = GenerateInverseProjection(aspect, fov, c.GetNearPlane(), c.GetFarPlane()) * clipSpace;
+	Vector3 viewPos = Vector3(transformed.x / transformed.w, transformed.y / transformed.w, transformed.z / transformed.w);
 
-	/*	Our transformed w coordinate is now the 'inverse' perspective divide, so
-		we can reconstruct the final world space by dividing x,y,and z by w. */
-	return Vector3(transformed.x / transformed.w, transformed.y / transformed.w, transformed.z / transformed.w);
+	//	The view matrix is only a rotation and a translation, so undoing it is cheap
+	return GenerateInverseViewTransform(c).TransformPoint(viewPos);
 }
 
 bool CollisionDetection::ObjectIntersection(GameObject* a, GameObject* b, CollisionInfo& collisionInfo) {
@@ -605,33 +758,21 @@ bool CollisionDetection::OBBSphereIntersection(
 	const OBBVolume& volumeA, const Transform& worldTransformA,
 	const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
 
-	// Inverse orientation of the OBB
-	Quaternion x = worldTransformA.GetOrientation();
-	x = x.Conjugate();
-
-	// Transform the sphere into the relative coordinates of the box using this inverse orientation
-	Vector3 localPosRelative = worldTransformB.GetPosition() - worldTransformA.GetPosition();
-	localPosRelative = x * localPosRelative;
+	// Transform the sphere into the relative coordinates of the box
+	RigidTransform boxTransform(worldTransformA.GetPosition(), worldTransformA.GetOrientation());
+	Vector3 localPosRelative = boxTransform.InverseTransformPoint(worldTransformB.GetPosition());
 
-	Transform localSphere;
-	localSphere.SetPosition(localPosRelative);
-
-	AABBVolume aabb(volumeA.GetHalfDimensions());
-	Transform aabbTransform;
-	aabbTransform.SetPosition(localPosRelative);
-	aabbTransform.SetScale(worldTransformA.GetScale());
-
-	Vector3 boxSize = aabb.GetHalfDimensions();
+	Vector3 boxSize = volumeA.GetHalfDimensions();
 
 	Vector3 closestPointOnBox = Maths::Clamp(localPosRelative, -boxSize, boxSize);
 
 	float distance = (closestPointOnBox - localPosRelative).Length();
 
 	if (distance < volumeB.GetRadius()) { // we're colliding
-		Vector3 collisionNormal = worldTransformA.GetOrientation() * -(closestPointOnBox - localPosRelative).Normalised();
+		Vector3 collisionNormal = boxTransform.TransformDirection(-(closestPointOnBox - localPosRelative).Normalised());
 		float penetration = (volumeB.GetRadius() - distance);
 
-		Vector3 localA = (worldTransformA.GetOrientation() * closestPointOnBox) + worldTransformA.GetPosition();
+		Vector3 localA = boxTransform.TransformPoint(closestPointOnBox);
 		Vector3 localB = -collisionNormal * volumeB.GetRadius();
 
 		collisionInfo.AddContactPoint(localA, localB, collisionNormal, penetration);
@@ -2,6 +2,8 @@
 
 #include "../../Common/Camera.h"
 #include "../../Common/Plane.h"
+#include "../../Common/Vector2.h"
+#include "../../Common/RigidTransform.h"
 
 #include "Transform.h"
 #include "GameObject.h"
@@ -63,7 +65,8 @@ namespace NCL {
 
 		static bool RayBoxIntersection(const Ray&r, const Vector3& boxPos, const Vector3& boxSize, RayCollision& collision);
 
-		static Ray BuildRayFromMouse(const Camera& c);
+		// The screen is passed in, rather than read from the Window, so a headless build never needs one
+		static Ray BuildRayFromMouse(const Camera& c, const Vector2& mousePosition, const Vector2& screenSize);
 
 		static bool RayIntersection(const Ray&r, GameObject& object, RayCollision &collisions);
 
@@ -76,6 +79,19 @@ namespace NCL {
 
 		static bool RayPlaneIntersection(const Ray&r, const Plane&p, RayCollision& collisions);
 
+		/*
+			The same tests as above, for four rays at a time. Each returns a bit
+			for every ray that hit (the first ray in bit 0), and sets how far along
+			each ray the hit was, or FLT_MAX if it missed.
+		*/
+		static int RayPacketIntersection(const RayPacket& rays, GameObject& object, float distances[4]);
+
+		static int RayPacketBoxIntersection(const RayPacket& rays, const Vector3& boxPos, const Vector3& boxSize, SIMD::Float4& distances);
+		static int RayPacketAABBIntersection(const RayPacket& rays, const Transform& worldTransform, const AABBVolume& volume, SIMD::Float4& distances);
+		static int RayPacketOBBIntersection(const RayPacket& rays, const Transform& worldTransform, const OBBVolume& volume, SIMD::Float4& distances);
+		static int RayPacketSphereIntersection(const RayPacket& rays, const Transform& worldTransform, const SphereVolume& volume, SIMD::Float4& distances);
+		static int RayPacketCapsuleIntersection(const RayPacket& rays, const Transform& worldTransform, const CapsuleVolume& volume, SIMD::Float4& distances);
+
 		static bool	AABBTest(const Vector3& posA, const Vector3& posB, const Vector3& halfSizeA, const Vector3& halfSizeB);
 
 
@@ -103,11 +119,12 @@ namespace NCL {
 		static bool OBBCapsuleIntersection(	const OBBVolume& volumeA, const Transform& worldTransformA,
 											const CapsuleVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo);
 
-		static Vector3 Unproject(const Vector3& screenPos, const Camera& cam);
+		static Vector3 Unproject(const Vector3& screenPos, const Camera& cam, const Vector2& screenSize);
 
-		static Vector3		UnprojectScreenPosition(Vector3 position, float aspect, float fov, const Camera &c);
+		static Vector3		UnprojectScreenPosition(Vector3 position, float aspect, float fov, const Camera &c, const Vector2& screenSize);
 		static Matrix4		GenerateInverseProjection(float aspect, float fov, float nearPlane, float farPlane);
 		static Matrix4		GenerateInverseView(const Camera &c);
+		static RigidTransform	GenerateInverseViewTransform(const Camera &c);
 
 	private:
 		CollisionDetection()	{}
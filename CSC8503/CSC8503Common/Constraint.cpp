@@ -1,14 +1,16 @@
 #include "Constraint.h"
 #include "../../Common/Maths.h"
-#include "../../Common/Window.h"
+#include <unordered_map>
+#include <algorithm>
 
 void NCL::CSC8503::PositionConstraint::UpdateConstraint(float dt) {
 	Vector3 relativePos = objectA->GetTransform().GetPosition() - objectB->GetTransform().GetPosition();
 	float currentDistance = relativePos.Length();
 	float offset = distance - currentDistance;
+	residual = 0.0f;
 
 	// Are we breaking the constraint?
-	if (abs(offset) > 0.0f) {
+	if (std::abs(offset) > 0.0f) {
 		Vector3 offsetDir = relativePos.Normalised();
 
 		PhysicsObject* physA = objectA->GetPhysicsObject();
@@ -26,6 +28,7 @@ void NCL::CSC8503::PositionConstraint::UpdateConstraint(float dt) {
 			float bias = -(biasFactor / dt) * offset;
 
 			float lambda = -(velocityDot + bias) / constraintMass;
+			residual = std::abs(velocityDot + bias);
 
 			Vector3 aImpulse = offsetDir * lambda;
 			Vector3 bImpulse = -offsetDir * lambda;
@@ -36,14 +39,227 @@ void NCL::CSC8503::PositionConstraint::UpdateConstraint(float dt) {
 	}
 }
 
-void NCL::CSC8503::PistonConstraint::UpdateConstraint(float dt) {
+using namespace NCL::CSC8503;
+
+/*
+	XPBD: rather than fixing up velocities, move the objects themselves so they're
+	the right distance apart again. The compliance (scaled by the substep length)
+	softens the correction, so 0 fixes the whole error, and anything higher lets
+	the constraint stretch like a spring.
+*/
+void PositionConstraint::SolvePositions(float dt) {
+	Transform& transformA = objectA->GetTransform();
+	Transform& transformB = objectB->GetTransform();
+
+	Vector3 relativePos		= transformA.GetPosition() - transformB.GetPosition();
+	float currentDistance	= relativePos.Length();
+	float error				= currentDistance - distance;
+	residual = std::abs(error);
+
+	if (currentDistance == 0.0f) {
+		return; // no idea which way to push them
+	}
+	float invMassA	= objectA->GetPhysicsObject()->GetInverseMass();
+	float invMassB	= objectB->GetPhysicsObject()->GetInverseMass();
+	float alpha		= compliance / (dt * dt);
+	float weight	= invMassA + invMassB + alpha;
+	if (weight <= 0.0f) {
+		return;
+	}
+	Vector3 correction = (relativePos / currentDistance) * (-error / weight);
+	transformA.SetPosition(transformA.GetPosition() + correction * invMassA);
+	transformB.SetPosition(transformB.GetPosition() - correction * invMassB);
+}
+
+ChainConstraint* ChainConstraint::FromLinks(const std::vector<PositionConstraint*>& links) {
+	if (links.empty()) {
+		return nullptr;
+	}
+	std::unordered_map<GameObject*, std::vector<PositionConstraint*>> linksOf;
+	for (PositionConstraint* l : links) {
+		if (l->GetObjectA() == l->GetObjectB()) {
+			return nullptr;
+		}
+		linksOf[l->GetObjectA()].emplace_back(l);
+		linksOf[l->GetObjectB()].emplace_back(l);
+	}
+	// a line has exactly two ends, and nothing in it has more than two links
+	for (auto& i : linksOf) {
+		if (i.second.size() > 2) {
+			return nullptr;
+		}
+	}
+	// start from the first end the links mention, not wherever the map's hashing puts one
+	GameObject* end = nullptr;
+	for (size_t i = 0; i < links.size() && !end; ++i) {
+		if (linksOf[links[i]->GetObjectA()].size() == 1) {
+			end = links[i]->GetObjectA();
+		}
+		else if (linksOf[links[i]->GetObjectB()].size() == 1) {
+			end = links[i]->GetObjectB();
+		}
+	}
+	if (!end) {
+		return nullptr; // a loop
+	}
+	std::vector<GameObject*>	bodies		= { end };
+	std::vector<float>			distances;
+	PositionConstraint*			previous	= nullptr;
 
-	// P Key to push pistons
-	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::P) && pistonDirection == PistonDirection::Resting) {
+	while (distances.size() < links.size()) {
+		std::vector<PositionConstraint*>& next = linksOf[bodies.back()];
+		PositionConstraint* link = (next[0] != previous) ? next[0] : (next.size() > 1 ? next[1] : nullptr);
+		if (!link) {
+			return nullptr; // ran out of line before using every link, so there's more than one
+		}
+		bodies.emplace_back(link->GetObjectA() == bodies.back() ? link->GetObjectB() : link->GetObjectA());
+		distances.emplace_back(link->GetDistance());
+		previous = link;
+	}
+	return new ChainConstraint(bodies, distances);
+}
+
+/*
+	Link i pushes bodies i and i+1 apart along their direction d[i] with an impulse
+	lambda[i]. We want every link's relative velocity along its direction to cancel
+	out its bias (the same bias a PositionConstraint uses), and as body i is also
+	pushed by link i-1, and body i+1 by link i+1, that gives for each link:
+
+	lower[i] * lambda[i-1] + diagonal[i] * lambda[i] + upper[i] * lambda[i+1] = rhs[i]
+
+	A link between two static objects can't do anything, so it gets lambda = 0.
+*/
+void ChainConstraint::UpdateConstraint(float dt) {
+	int links = GetLinkCount();
+	if (links == 0) {
+		return;
+	}
+	directions.resize(links);
+	lower.resize(links);
+	diagonal.resize(links);
+	upper.resize(links);
+	rhs.resize(links);
+
+	const float biasFactor = 0.01f;
+	residual = 0.0f;
+
+	for (int i = 0; i < links; ++i) {
+		PhysicsObject* physA = bodies[i]->GetPhysicsObject();
+		PhysicsObject* physB = bodies[i + 1]->GetPhysicsObject();
+
+		Vector3 relativePos		= bodies[i]->GetTransform().GetPosition() - bodies[i + 1]->GetTransform().GetPosition();
+		float currentDistance	= relativePos.Length();
+		float offset			= distances[i] - currentDistance;
+		directions[i]			= relativePos.Normalised();
+
+		float invMassA = physA->GetInverseMass();
+		float invMassB = physB->GetInverseMass();
+
+		Vector3 relativeVelocity = physA->GetLinearVelocity() - physB->GetLinearVelocity();
+		float bias = -(biasFactor / dt) * offset;
+
+		diagonal[i]	= invMassA + invMassB;
+		rhs[i]		= -(Vector3::Dot(relativeVelocity, directions[i]) + bias);
+		lower[i]	= (i > 0) ? -invMassA * Vector3::Dot(directions[i], directions[i - 1]) : 0.0f;
+		upper[i]	= 0.0f; // filled in once we know the next link's direction
+		if (i > 0) {
+			upper[i - 1] = -invMassA * Vector3::Dot(directions[i - 1], directions[i]);
+		}
+		if (diagonal[i] <= 0.0f) {
+			diagonal[i]	= 1.0f;
+			rhs[i]		= 0.0f;
+		}
+		residual = std::max(residual, std::abs(rhs[i]));
+	}
+
+	SolveTridiagonal(links);
+
+	for (int i = 0; i < links; ++i) {
+		Vector3 impulse = directions[i] * rhs[i];
+		bodies[i]->GetPhysicsObject()->ApplyLinearImpulse(impulse);
+		bodies[i + 1]->GetPhysicsObject()->ApplyLinearImpulse(-impulse);
+	}
+}
+
+/*
+	The XPBD version of the above - each link's error is now how far it is from its
+	distance, and its compliance makes it a little easier to move, so the system
+	only differs in its diagonal and right hand side. The result is how far along
+	its direction each link has to push its objects (scaled by their inverse mass).
+*/
+void ChainConstraint::SolvePositions(float dt) {
+	int links = GetLinkCount();
+	if (links == 0) {
+		return;
+	}
+	directions.resize(links);
+	lower.resize(links);
+	diagonal.resize(links);
+	upper.resize(links);
+	rhs.resize(links);
+
+	const float alpha = compliance / (dt * dt);
+	residual = 0.0f;
+
+	for (int i = 0; i < links; ++i) {
+		float invMassA = bodies[i]->GetPhysicsObject()->GetInverseMass();
+		float invMassB = bodies[i + 1]->GetPhysicsObject()->GetInverseMass();
+
+		Vector3 relativePos		= bodies[i]->GetTransform().GetPosition() - bodies[i + 1]->GetTransform().GetPosition();
+		float currentDistance	= relativePos.Length();
+		float error				= currentDistance - distances[i];
+		directions[i]			= relativePos.Normalised();
+
+		diagonal[i]	= invMassA + invMassB + alpha;
+		rhs[i]		= -error;
+		lower[i]	= (i > 0) ? -invMassA * Vector3::Dot(directions[i], directions[i - 1]) : 0.0f;
+		upper[i]	= 0.0f;
+		if (i > 0) {
+			upper[i - 1] = -invMassA * Vector3::Dot(directions[i - 1], directions[i]);
+		}
+		if (diagonal[i] <= 0.0f) {
+			diagonal[i]	= 1.0f;
+			rhs[i]		= 0.0f;
+		}
+		residual = std::max(residual, std::abs(error));
+	}
+
+	SolveTridiagonal(links);
+
+	for (int i = 0; i < links; ++i) {
+		Transform& a = bodies[i]->GetTransform();
+		Transform& b = bodies[i + 1]->GetTransform();
+		Vector3 correction = directions[i] * rhs[i];
+		a.SetPosition(a.GetPosition() + correction * bodies[i]->GetPhysicsObject()->GetInverseMass());
+		b.SetPosition(b.GetPosition() - correction * bodies[i + 1]->GetPhysicsObject()->GetInverseMass());
+	}
+}
+
+// Thomas algorithm, leaving the solution in rhs
+void ChainConstraint::SolveTridiagonal(int links) {
+	// eliminate the lower diagonal going forwards...
+	upper[0]	/= diagonal[0];
+	rhs[0]		/= diagonal[0];
+	for (int i = 1; i < links; ++i) {
+		float denominator = diagonal[i] - lower[i] * upper[i - 1];
+		upper[i]	/= denominator;
+		rhs[i]		= (rhs[i] - lower[i] * rhs[i - 1]) / denominator;
+	}
+	// ...then substitute back
+	for (int i = links - 2; i >= 0; --i) {
+		rhs[i] -= upper[i] * rhs[i + 1];
+	}
+}
+
+void NCL::CSC8503::PistonConstraint::Push() {
+	if (pistonDirection == PistonDirection::Resting) {
 		Vector3 impulse = moveConstraint * 400.0f;
 		piston->GetPhysicsObject()->ApplyLinearImpulse(impulse);
 		pistonDirection = PistonDirection::Contracting;
 	}
+}
+
+void NCL::CSC8503::PistonConstraint::UpdateConstraint(float dt) {
 
 	Vector3 limitConstraint;
 	if (pistonDirection == PistonDirection::Contracting) {
@@ -56,7 +272,7 @@ void NCL::CSC8503::PistonConstraint::UpdateConstraint(float dt) {
 	}
 	
 	Vector3 distanceTravelled = piston->GetTransform().GetPosition() - restingPosition;
-	float d = abs(distanceTravelled.Length());
+	float d = std::abs(distanceTravelled.Length());
 	
 	if (d > 50 && pistonDirection == PistonDirection::Contracting) {
 		pistonDirection = PistonDirection::Retracting;
@@ -81,25 +297,11 @@ void NCL::CSC8503::PistonConstraint::UpdateConstraint(float dt) {
 }
 
 void NCL::CSC8503::BalancingPlaneConstraint::UpdateConstraint(float dt) {
-
-	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::UP)) {
-		pushOrientation->x = 3.0f;
-	}	
-	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::DOWN)) {
-		pushOrientation->x = -3.0f;
-	}
-	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::LEFT)) {
-		pushOrientation->z = -3.0f;
-	}
-	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::RIGHT)) {
-		pushOrientation->z = 3.0f;
-	}
-
 	Vector3 relativePos = balancingPlane->GetTransform().GetPosition() - restingPosition;
 	float currentDistance = relativePos.Length();
 	float offset = maxBalancingBoardDistanceOffset - currentDistance;
 
-	if (abs(offset) > 0.0f) {
+	if (std::abs(offset) > 0.0f) {
 		Vector3 offsetDir = relativePos.Normalised();
 
 		PhysicsObject* phys = balancingPlane->GetPhysicsObject();
@@ -121,6 +323,4 @@ void NCL::CSC8503::BalancingPlaneConstraint::UpdateConstraint(float dt) {
 			phys->ApplyAngularImpulse(*pushOrientation);
 		}
 	}
-
-	*pushOrientation = Vector3(0.0f, 0.0f, 0.0f);
 }
\ No newline at end of file
@@ -1,13 +1,56 @@
 #pragma once
+#include <vector>
 
 namespace NCL {
 	namespace CSC8503 {
+		class GameObject;
+
 		class Constraint	{
 		public:
 			Constraint() {}
 			virtual ~Constraint() {}
 
 			virtual void UpdateConstraint(float dt) = 0;
+
+			/*
+				Adds the objects this constraint reads and writes to bodies. Constraints
+				that don't say are never solved in parallel.
+			*/
+			virtual void GetBodies(std::vector<GameObject*>& bodies) const {
+			}
+
+			/*
+				The largest error the last solve found - a velocity after UpdateConstraint,
+				or a distance after SolvePositions - or -1 if it can't tell.
+			*/
+			float GetResidual() const {
+				return residual;
+			}
+
+			/*
+				For the XPBD solver - moves the objects straight back to where the constraint
+				wants them, once per substep. Constraints that can't do this keep being
+				solved on velocities by UpdateConstraint, once per step.
+			*/
+			virtual bool CanSolvePositions() const {
+				return false;
+			}
+			virtual void SolvePositions(float dt) {
+			}
+
+			/*
+				How soft the constraint is, in metres per newton (the inverse of its
+				stiffness) - 0 is completely rigid. Only the XPBD solver uses it.
+			*/
+			void SetCompliance(float c) {
+				compliance = c;
+			}
+			float GetCompliance() const {
+				return compliance;
+			}
+		protected:
+			float residual		= -1.0f;
+			float compliance	= 0.0f;
 		};
 	}
 }
@@ -31,6 +74,26 @@ namespace NCL {
 				~PositionConstraint() {}
 				
 				void UpdateConstraint(float dt) override;
+
+				bool CanSolvePositions() const override {
+					return true;
+				}
+				void SolvePositions(float dt) override;
+
+				void GetBodies(std::vector<GameObject*>& bodies) const override {
+					bodies.emplace_back(objectA);
+					bodies.emplace_back(objectB);
+				}
+
+				GameObject* GetObjectA() const {
+					return objectA;
+				}
+				GameObject* GetObjectB() const {
+					return objectB;
+				}
+				float GetDistance() const {
+					return distance;
+				}
 			protected:
 				GameObject* objectA;
 				GameObject* objectB;
@@ -40,6 +103,67 @@ namespace NCL {
 	}
 }
 
+namespace NCL {
+	namespace CSC8503 {
+		class GameObject;
+
+		/*
+			A line of objects, each held at a fixed distance from the next - the same as a
+			PositionConstraint between each neighbouring pair, but solved all at once.
+
+			Solving the links one at a time, an impulse fixing one link stretches its
+			neighbours, so a long chain needs lots of iterations to stop it sagging. The
+			impulses every link needs at once form a tridiagonal system, as each link
+			only shares an object with the links either side of it, and that can be
+			solved exactly in a single O(n) pass with the Thomas algorithm.
+		*/
+		class ChainConstraint : public Constraint {
+			public:
+				// bodies.size() - 1 links, with link i joining bodies[i] and bodies[i + 1]
+				ChainConstraint(const std::vector<GameObject*>& bodies, const std::vector<float>& distances) {
+					this->bodies	= bodies;
+					this->distances	= distances;
+				}
+				~ChainConstraint() {}
+
+				/*
+					Joins up PositionConstraints that form a single unbranching line, in any
+					order and direction, into one ChainConstraint. Returns nullptr if they
+					don't - the links are left untouched either way.
+				*/
+				static ChainConstraint* FromLinks(const std::vector<PositionConstraint*>& links);
+
+				void UpdateConstraint(float dt) override;
+
+				bool CanSolvePositions() const override {
+					return true;
+				}
+				// Every link moved back into place at once, with the same tridiagonal solve
+				void SolvePositions(float dt) override;
+
+				void GetBodies(std::vector<GameObject*>& bodies) const override {
+					bodies.insert(bodies.end(), this->bodies.begin(), this->bodies.end());
+				}
+
+				int GetLinkCount() const {
+					return (int)distances.size();
+				}
+			protected:
+				void SolveTridiagonal(int links);
+
+				std::vector<GameObject*>	bodies;
+				std::vector<float>			distances;
+
+				// kept between updates, to save reallocating them
+				std::vector<Vector3>	directions;
+				std::vector<float>		lower;
+				std::vector<float>		diagonal;
+				std::vector<float>		upper;
+				std::vector<float>		rhs;
+		};
+	}
+}
+
 namespace NCL {
 	namespace CSC8503 {
 		class GameObject;
@@ -82,6 +206,13 @@ namespace NCL {
 				~PistonConstraint() {}
 				
 				void UpdateConstraint(float dt) override;
+
+				// Fires the piston out, if it's back at rest
+				void Push();
+
+				void GetBodies(std::vector<GameObject*>& bodies) const override {
+					bodies.emplace_back(piston);
+				}
 			protected:
 				PistonDirection pistonDirection;
 				Vector3 moveConstraint;
@@ -127,6 +258,18 @@ namespace NCL {
 				~BalancingPlaneConstraint() {}
 				
 				void UpdateConstraint(float dt) override;
+
+				// The angular impulse the plane is tilted by on every solve, until it's set back to zero
+				void SetPushOrientation(const Vector3& push) {
+					*pushOrientation = push;
+				}
+				Vector3 GetPushOrientation() const {
+					return *pushOrientation;
+				}
+
+				void GetBodies(std::vector<GameObject*>& bodies) const override {
+					bodies.emplace_back(balancingPlane);
+				}
 			protected:
 				GameObject* balancingPlane;
 				Vector3 restingPosition;
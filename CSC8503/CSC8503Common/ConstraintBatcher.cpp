@@ -0,0 +1,43 @@
+#include "ConstraintBatcher.h"
+#include "Constraint.h"
+#include <unordered_map>
+#include <cstdint>
+
+using namespace NCL::CSC8503;
+
+void ConstraintBatcher::Build(std::vector<Constraint*>::const_iterator first, std::vector<Constraint*>::const_iterator last) {
+	batches.clear();
+	serial.clear();
+
+	// bit n is set if the object is already used by a constraint in batch n
+	std::unordered_map<GameObject*, uint64_t> usedBatches;
+	std::vector<GameObject*> bodies;
+
+	for (auto i = first; i != last; ++i) {
+		bodies.clear();
+		(*i)->GetBodies(bodies);
+		if (bodies.empty()) {
+			serial.emplace_back(*i);
+			continue;
+		}
+		uint64_t used = 0;
+		for (GameObject* b : bodies) {
+			used |= usedBatches[b];
+		}
+		int batch = 0;
+		while (batch < maxBatches && (used & (uint64_t(1) << batch))) {
+			batch++;
+		}
+		if (batch == maxBatches) {
+			serial.emplace_back(*i);
+			continue;
+		}
+		for (GameObject* b : bodies) {
+			usedBatches[b] |= uint64_t(1) << batch;
+		}
+		if (batch == (int)batches.size()) {
+			batches.emplace_back();
+		}
+		batches[batch].emplace_back(*i);
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+namespace NCL {
+	namespace CSC8503 {
+		class Constraint;
+
+		/*
+			Splits the world's constraints into batches in which no two constraints touch
+			the same object, by greedily colouring the graph of objects joined by
+			constraints. Everything in a batch can then be solved at the same time, and
+			as constraints in a batch are independent, their order within it doesn't
+			matter - only the order of the batches does.
+
+			A chain only needs 2 batches, however long it is. Anything that can't be
+			coloured (more than maxBatches batches, or a constraint that doesn't report
+			its objects) goes into a final batch that must be solved serially.
+		*/
+		class ConstraintBatcher	{
+		public:
+			static const int maxBatches = 64;
+
+			ConstraintBatcher() {}
+			~ConstraintBatcher() {}
+
+			void Build(std::vector<Constraint*>::const_iterator first, std::vector<Constraint*>::const_iterator last);
+
+			int GetBatchCount() const {
+				return (int)batches.size();
+			}
+			const std::vector<Constraint*>& GetBatch(int i) const {
+				return batches[i];
+			}
+			const std::vector<Constraint*>& GetSerialBatch() const {
+				return serial;
+			}
+
+		protected:
+			std::vector<std::vector<Constraint*>>	batches;
+			std::vector<Constraint*>				serial;
+		};
+	}
+}
@@ -43,4 +43,11 @@ void GameObject::UpdateBroadphaseAABB() {
 		Vector3 halfSizes = ((OBBVolume&)*boundingVolume).GetHalfDimensions();
 		broadphaseAABB = mat * halfSizes;
 	}
+	else if (boundingVolume->type == VolumeType::Capsule) {
+		// the capsule's inner line segment, plus its radius in every direction
+		const CapsuleVolume& capsule = (CapsuleVolume&)*boundingVolume;
+		Vector3 axis = transform.GetOrientation() * Vector3(0, 1, 0) * (capsule.GetHalfHeight() - capsule.GetRadius());
+		float r = capsule.GetRadius();
+		broadphaseAABB = Vector3(std::abs(axis.x) + r, std::abs(axis.y) + r, std::abs(axis.z) + r);
+	}
 }
\ No newline at end of file
@@ -85,6 +85,7 @@ namespace NCL {
 			}
 
 			int GetScore() { return score; }
+			void SetScore(int s) { score = s; }
 
 			bool isToDelete() { return toDelete; }
 			void setToDelete(bool b) { this->toDelete = b; }
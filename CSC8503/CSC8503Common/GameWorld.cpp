@@ -1,6 +1,7 @@
 #include "GameWorld.h"
 #include "GameObject.h"
 #include "Constraint.h"
+#include "WorkerPool.h"
 #include "CollisionDetection.h"
 #include "../../Common/Camera.h"
 #include <algorithm>
@@ -13,7 +14,10 @@ GameWorld::GameWorld()	{
 
 	shuffleConstraints	= false;
 	shuffleObjects		= false;
+	deterministic		= false;
 	worldIDCounter		= 0;
+	constraintVersion	= 0;
+	objectVersion		= 0;
 }
 
 GameWorld::~GameWorld()	{
@@ -22,6 +26,8 @@ GameWorld::~GameWorld()	{
 void GameWorld::Clear() {
 	gameObjects.clear();
 	constraints.clear();
+	constraintVersion++;
+	objectVersion++;
 }
 
 void GameWorld::ClearAndErase() {
@@ -37,10 +43,12 @@ void GameWorld::ClearAndErase() {
 void GameWorld::AddGameObject(GameObject* o) {
 	gameObjects.emplace_back(o);
 	o->SetWorldID(worldIDCounter++);
+	objectVersion++;
 }
 
 void GameWorld::RemoveGameObject(GameObject* o, bool andDelete) {
 	gameObjects.erase(std::remove(gameObjects.begin(), gameObjects.end(), o), gameObjects.end());
+	objectVersion++;
 	if (andDelete) {
 		delete o;
 	}
@@ -60,7 +68,21 @@ void GameWorld::OperateOnContents(GameObjectFunc f) {
 	}
 }
 
+void GameWorld::SetDeterministic(bool state) {
+	deterministic = state;
+	if (deterministic) { // undo any shuffling done before now
+		std::sort(gameObjects.begin(), gameObjects.end(),
+			[](GameObject* a, GameObject* b) {
+				return a->GetWorldID() < b->GetWorldID();
+			}
+		);
+	}
+}
+
 void GameWorld::UpdateWorld(float dt) {
+	if (deterministic) {
+		return;
+	}
 	if (shuffleObjects) {
 		std::random_shuffle(gameObjects.begin(), gameObjects.end());
 	}
@@ -70,15 +92,59 @@ void GameWorld::UpdateWorld(float dt) {
 	}
 }
 
-#include "PhysicsSystem.h"
+/*
+	Children are built from their parent's matrix, so the dirty transforms are
+	sorted by depth (a counting sort, as there are only ever a few levels), and
+	each level is finished before the next is started. Everything within a level
+	is independent, so each one can still be split between the workers.
+*/
+void GameWorld::UpdateTransforms(WorkerPool* workers) {
+	dirtyTransforms.clear();
+	depthStarts.assign(2, 0);
+	for (GameObject* o : gameObjects) {
+		const Transform& t = o->GetTransform();
+		if (t.IsMatrixDirty()) {
+			dirtyTransforms.emplace_back(&t);
+			int depth = t.GetDepth();
+			if (depth + 2 > (int)depthStarts.size()) {
+				depthStarts.resize(depth + 2, 0);
+			}
+			depthStarts[depth + 1]++;
+		}
+	}
+	if (depthStarts.size() > 2) { // there's a hierarchy, so put the parents first
+		for (size_t i = 1; i < depthStarts.size(); ++i) {
+			depthStarts[i] += depthStarts[i - 1];
+		}
+		sortedTransforms.resize(dirtyTransforms.size());
+		depthEnds.assign(depthStarts.begin(), depthStarts.end() - 1);
+		for (const Transform* t : dirtyTransforms) {
+			sortedTransforms[depthEnds[t->GetDepth()]++] = t;
+		}
+		dirtyTransforms.swap(sortedTransforms);
+	}
+
+	for (size_t level = 0; level + 1 < depthStarts.size(); ++level) {
+		int first		= depthStarts[level];
+		int levelCount	= depthStarts[level + 1] - first;
+		auto update = [&](int begin, int end) {
+			for (int i = first + begin; i < first + end; ++i) {
+				dirtyTransforms[i]->UpdateMatrix();
+			}
+		};
+		if (workers && levelCount >= minParallelTransforms) {
+			workers->ParallelFor(levelCount, update, minParallelTransforms / 2);
+		}
+		else {
+			update(0, levelCount);
+		}
+	}
+}
 
 bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObject, GameObject* ignoreGO) const {
 	//The simplest raycast just goes through each object and sees if there's a collision
 	RayCollision collision;
 
-	// fire ray to find correct quad first
-	//std::set<CollisionDetection::CollisionInfo>* potentialCollisions = PhysicsSystem::PotentialCollisionsFromRay(r);
-	
 	for (auto& i : gameObjects) {
 		if (!i->GetBoundingVolume()) { //objects might not be collideable etc...
 			continue;
@@ -111,12 +177,54 @@ bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObje
 	return false;
 }
 
+int GameWorld::Raycast(const RayPacket& rays, RayCollision closestCollisions[4], GameObject* ignoreGO) const {
+	for (int i = 0; i < 4; ++i) {
+		closestCollisions[i] = RayCollision();
+	}
+	int hits = 0;
+	for (auto& o : gameObjects) {
+		if (!o->GetBoundingVolume() || o == ignoreGO) {
+			continue;
+		}
+		float distances[4];
+		int objectHits = CollisionDetection::RayPacketIntersection(rays, *o, distances);
+		for (int i = 0; i < 4; ++i) {
+			if ((objectHits & (1 << i)) && distances[i] < closestCollisions[i].rayDistance) {
+				closestCollisions[i].rayDistance	= distances[i];
+				closestCollisions[i].node			= o;
+			}
+		}
+		hits |= objectHits;
+	}
+	if (hits) { //only need to work out where the closest hits were
+		float origins[3][4];
+		float directions[3][4];
+		SIMD::Store(origins[0], rays.originX);
+		SIMD::Store(origins[1], rays.originY);
+		SIMD::Store(origins[2], rays.originZ);
+		SIMD::Store(directions[0], rays.directionX);
+		SIMD::Store(directions[1], rays.directionY);
+		SIMD::Store(directions[2], rays.directionZ);
+		for (int i = 0; i < 4; ++i) {
+			if (!(hits & (1 << i))) {
+				continue;
+			}
+			Vector3 origin(origins[0][i], origins[1][i], origins[2][i]);
+			Vector3 direction(directions[0][i], directions[1][i], directions[2][i]);
+			closestCollisions[i].collidedAt = origin + (direction * closestCollisions[i].rayDistance);
+		}
+	}
+	return hits;
+}
+
 void GameWorld::AddConstraint(Constraint* c) {
 	constraints.emplace_back(c);
+	constraintVersion++;
 }
 
 void GameWorld::RemoveConstraint(Constraint* c, bool andDelete) {
 	constraints.erase(std::remove(constraints.begin(), constraints.end(), c), constraints.end());
+	constraintVersion++;
 	if (andDelete) {
 		delete c;
 	}
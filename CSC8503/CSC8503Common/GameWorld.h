@@ -9,6 +9,8 @@ namespace NCL {
 	namespace CSC8503 {
 		class GameObject;
 		class Constraint;
+		class Transform;
+		class WorkerPool;
 
 		typedef std::function<void(GameObject*)> GameObjectFunc;
 		typedef std::vector<GameObject*>::const_iterator GameObjectIterator;
@@ -39,10 +41,33 @@ namespace NCL {
 				shuffleObjects = state;
 			}
 
+			/*
+				Keeps the objects in the order they were added (by world ID), and never
+				shuffles them or the constraints, so that the same level fed the same
+				inputs always updates in the same order. Constraints can't be put back
+				in order, so turn this on before any have been shuffled.
+			*/
+			void SetDeterministic(bool state);
+			bool IsDeterministic() const {
+				return deterministic;
+			}
+
 			bool Raycast(Ray& r, RayCollision& closestCollision, bool closestObject = false, GameObject* ignoreGO = nullptr) const;
 
+			// Finds the closest object along each of four rays in one pass, returning a bit for each that hit something
+			int Raycast(const RayPacket& rays, RayCollision closestCollisions[4], GameObject* ignoreGO = nullptr) const;
+
 			virtual void UpdateWorld(float dt);
 
+			/*
+				Rebuilds every out of date object matrix in one go, ready for rendering.
+				The out of date transforms are gathered into one list first, parents
+				ahead of their children, which is then split between the workers, if
+				there are enough of them to be worth waking up. Any parent has to be
+				in the world too.
+			*/
+			void UpdateTransforms(WorkerPool* workers = nullptr);
+
 			void OperateOnContents(GameObjectFunc f);
 
 			void GetObjectIterators(
@@ -53,6 +78,15 @@ namespace NCL {
 				std::vector<Constraint*>::const_iterator& first,
 				std::vector<Constraint*>::const_iterator& last) const;
 
+			// Changes whenever a constraint is added or removed
+			int GetConstraintVersion() const {
+				return constraintVersion;
+			}
+			// ...and this whenever an object is
+			int GetObjectVersion() const {
+				return objectVersion;
+			}
+
 		protected:
 			std::vector<GameObject*> gameObjects;
 			std::vector<Constraint*> constraints;
@@ -61,7 +95,17 @@ namespace NCL {
 
 			bool	shuffleConstraints;
 			bool	shuffleObjects;
+			bool	deterministic;
 			int		worldIDCounter;
+			int		constraintVersion;
+			int		objectVersion;
+
+			std::vector<const Transform*> dirtyTransforms; // kept between updates, to save reallocating it
+			std::vector<const Transform*> sortedTransforms;
+			std::vector<int> depthStarts;	// where each depth's transforms begin in dirtyTransforms
+			std::vector<int> depthEnds;
+
+			static const int minParallelTransforms = 256;
 		};
 	}
 }
@@ -0,0 +1,214 @@
+#pragma once
+#include "../../Common/Vector3.h"
+#include "../CSC8503Common/CollisionDetection.h"
+#include <list>
+#include <functional>
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace CSC8503 {
+		template<class T>
+		class Octree;
+
+		template<class T>
+		struct OctreeEntry {
+			Vector3 pos;
+			Vector3 size;
+			T object;
+			int index; // the order it was inserted in
+
+			OctreeEntry(T obj, Vector3 pos, Vector3 size, int index) {
+				object		= obj;
+				this->pos	= pos;
+				this->size	= size;
+				this->index	= index;
+			}
+		};
+
+		/*
+			A loose octree - every node's bounds are stretched to twice their 'tight' size,
+			so an object can always be placed in exactly one node: the deepest one whose
+			tight bounds contain its centre, and whose children are still big enough to
+			hold all of it. Unlike the QuadTree, nothing is ever duplicated across nodes,
+			and splitting a node just moves entries down a level, rather than reinserting
+			them into every child.
+
+			As a node's contents might overlap things in neighbouring nodes, pairs should
+			be found using OperateOnPairs rather than by pairing up each node's contents.
+		*/
+		template<class T>
+		class OctreeNode {
+		public:
+			typedef std::function<void(std::list<OctreeEntry<T>>&)> OctreeFunc;
+			typedef std::function<void(OctreeEntry<T>&, OctreeEntry<T>&)> OctreePairFunc;
+		protected:
+			friend class Octree<T>;
+
+			OctreeNode() {
+				children = nullptr;
+			}
+
+			OctreeNode(Vector3 pos, Vector3 size) {
+				children		= nullptr;
+				this->position	= pos;
+				this->size		= size;
+			}
+
+			~OctreeNode() {
+				delete[] children;
+			}
+
+			void Insert(T& object, const Vector3& objectPos, const Vector3& objectSize, int index, int depthLeft, int maxSize) {
+				if (children) {
+					OctreeNode<T>* child = ChildFor(objectPos, objectSize);
+					if (child) { // fits entirely inside one child's loose bounds, so push it down
+						child->Insert(object, objectPos, objectSize, index, depthLeft - 1, maxSize);
+						return;
+					}
+				}
+				contents.push_back(OctreeEntry<T>(object, objectPos, objectSize, index));
+
+				if (!children && (int)contents.size() > maxSize && depthLeft > 0) {
+					Split();
+					// move whatever now fits into a child down a level - the rest stays here
+					for (auto i = contents.begin(); i != contents.end(); ) {
+						OctreeNode<T>* child = ChildFor(i->pos, i->size);
+						if (child) {
+							auto next = std::next(i);
+							child->contents.splice(child->contents.end(), contents, i);
+							i = next;
+						}
+						else {
+							++i;
+						}
+					}
+				}
+			}
+
+			// The child whose octant holds the object's centre, as long as its loose bounds can hold all of it
+			OctreeNode<T>* ChildFor(const Vector3& objectPos, const Vector3& objectSize) {
+				Vector3 offset = objectPos - position;
+				if (std::abs(offset.x) > size.x || std::abs(offset.y) > size.y || std::abs(offset.z) > size.z) {
+					return nullptr; // centre isn't even inside this node
+				}
+				Vector3 halfSize = size / 2.0f;
+				if (objectSize.x > halfSize.x || objectSize.y > halfSize.y || objectSize.z > halfSize.z) {
+					return nullptr;
+				}
+				int index = 0;
+				index |= (objectPos.x >= position.x) ? 1 : 0;
+				index |= (objectPos.y >= position.y) ? 2 : 0;
+				index |= (objectPos.z >= position.z) ? 4 : 0;
+				return &children[index];
+			}
+
+			void Split() {
+				Vector3 halfSize = size / 2.0f;
+				children = new OctreeNode<T>[8];
+				for (int i = 0; i < 8; ++i) {
+					Vector3 offset(
+						(i & 1) ? halfSize.x : -halfSize.x,
+						(i & 2) ? halfSize.y : -halfSize.y,
+						(i & 4) ? halfSize.z : -halfSize.z
+					);
+					children[i] = OctreeNode<T>(position + offset, halfSize);
+				}
+			}
+
+			void DebugDraw() {
+
+			}
+
+			void OperateOnContents(OctreeFunc& func) {
+				if (!contents.empty()) {
+					func(contents);
+				}
+				if (children) {
+					for (int i = 0; i < 8; ++i) {
+						children[i].OperateOnContents(func);
+					}
+				}
+			}
+
+			/*
+				Loose bounds overlap their neighbours, so an object can touch things stored
+				in any node whose loose bounds it overlaps - not just those above or below it.
+				The root is never culled, as it also holds anything outside of the tree.
+			*/
+			void OperateOnOverlaps(const Vector3& objectPos, const Vector3& objectSize, OctreePairFunc& func, OctreeEntry<T>& entry, bool isRoot) {
+				if (!isRoot && !CollisionDetection::AABBTest(objectPos, position, objectSize, size * 2.0f)) {
+					return;
+				}
+				for (auto& i : contents) {
+					// both objects will find each other, so only the one inserted first reports it - using
+					// their addresses instead would make the order pairs come out in depend on the heap
+					if (entry.index < i.index &&
+						CollisionDetection::AABBTest(objectPos, i.pos, objectSize, i.size)) {
+						func(entry, i);
+					}
+				}
+				if (children) {
+					for (int i = 0; i < 8; ++i) {
+						children[i].OperateOnOverlaps(objectPos, objectSize, func, entry, false);
+					}
+				}
+			}
+
+		protected:
+			std::list<OctreeEntry<T>> contents;
+
+			Vector3 position;
+			Vector3 size;
+
+			OctreeNode<T>* children;
+		};
+	}
+}
+
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace CSC8503 {
+		template<class T>
+		class Octree
+		{
+		public:
+			Octree(Vector3 size, int maxDepth = 6, int maxSize = 5) {
+				root = OctreeNode<T>(Vector3(), size);
+				this->maxDepth	= maxDepth;
+				this->maxSize	= maxSize;
+			}
+			~Octree() {
+			}
+
+			// Anything too big (or too far out) for the root's children just lives in the root
+			void Insert(T object, const Vector3& pos, const Vector3& size) {
+				root.Insert(object, pos, size, insertCount++, maxDepth, maxSize);
+			}
+
+			void DebugDraw() {
+				root.DebugDraw();
+			}
+
+			void OperateOnContents(typename OctreeNode<T>::OctreeFunc func) {
+				root.OperateOnContents(func);
+			}
+
+			// Calls func once for every pair of entries whose bounding boxes overlap
+			void OperateOnPairs(typename OctreeNode<T>::OctreePairFunc func) {
+				typename OctreeNode<T>::OctreeFunc eachNode = [&](std::list<OctreeEntry<T>>& data) {
+					for (auto& i : data) {
+						root.OperateOnOverlaps(i.pos, i.size, func, i, true);
+					}
+				};
+				root.OperateOnContents(eachNode);
+			}
+
+		protected:
+			OctreeNode<T> root;
+			int maxDepth;
+			int maxSize;
+			int insertCount = 0;
+		};
+	}
+}
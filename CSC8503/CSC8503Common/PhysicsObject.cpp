@@ -1,6 +1,7 @@
 #include "PhysicsObject.h"
 #include "PhysicsSystem.h"
 #include "../CSC8503Common/Transform.h"
+#include "../../Common/SIMD.h"
 using namespace NCL;
 using namespace CSC8503;
 
@@ -12,12 +13,21 @@ PhysicsObject::PhysicsObject(Transform* parentTransform, const CollisionVolume*
 	elasticity	= 0.8f;
 	friction	= 0.8f;
 	collisionType = CollisionType::Impulse; // an impulse collision by default
+	tensorDirty	= true;
 }
 
 PhysicsObject::~PhysicsObject()	{
 
 }
 
+void PhysicsObject::SetInverseMass(float invMass) {
+	inverseMass = invMass;
+	tensorDirty = true;
+	if (inverseMass == 0.0f) {
+		inverseInteriaTensor.ToZero();
+	}
+}
+
 void PhysicsObject::ApplyAngularImpulse(const Vector3& force) {
 	if (force.Length() > 0) {
 		bool a = true;
@@ -71,6 +81,7 @@ void PhysicsObject::InitCubeInertia() {
 	inverseInertia.x = (12.0f * inverseMass) / (dimsSqr.y + dimsSqr.z);
 	inverseInertia.y = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.z);
 	inverseInertia.z = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.y);
+	tensorDirty = true;
 }
 
 void PhysicsObject::InitSphereInertia() {
@@ -79,13 +90,58 @@ void PhysicsObject::InitSphereInertia() {
 	float i			= 2.5f * inverseMass / (radius*radius);			// for solid sphere
 
 	inverseInertia	= Vector3(i, i, i);
+	tensorDirty		= true;
 }
 
 void PhysicsObject::UpdateInertiaTensor() {
+	if (inverseMass == 0.0f) {
+		return;
+	}
 	Quaternion q = transform->GetOrientation();
-	
-	Matrix3 invOrientation	= Matrix3(q.Conjugate());
-	Matrix3 orientation		= Matrix3(q);
+	if (!tensorDirty && q.x == tensorOrientation.x && q.y == tensorOrientation.y &&
+		q.z == tensorOrientation.z && q.w == tensorOrientation.w) {
+		return;
+	}
+	BuildInertiaTensor(q);
+}
 
-	inverseInteriaTensor = orientation * Matrix3::Scale(inverseInertia) *invOrientation;
-}
\ No newline at end of file
+void PhysicsObject::RestoreInertiaTensor(const Quaternion& orientation) {
+	if (inverseMass == 0.0f) {
+		return;
+	}
+	BuildInertiaTensor(orientation);
+}
+
+/*
+	R * diag(inverseInertia) * R^T, without building either matrix: column j of
+	the result is the sum of each of R's columns, scaled by its inertia and by
+	its own j'th element.
+*/
+void PhysicsObject::BuildInertiaTensor(const Quaternion& q) {
+	tensorOrientation	= q;
+	tensorDirty			= false;
+
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float xw = q.x * q.w, yw = q.y * q.w, zw = q.z * q.w;
+
+	SIMD::Float4 r0 = SIMD::Set(1 - 2 * yy - 2 * zz, 2 * xy + 2 * zw, 2 * xz - 2 * yw, 0.0f);
+	SIMD::Float4 r1 = SIMD::Set(2 * xy - 2 * zw, 1 - 2 * xx - 2 * zz, 2 * yz + 2 * xw, 0.0f);
+	SIMD::Float4 r2 = SIMD::Set(2 * xz + 2 * yw, 2 * yz - 2 * xw, 1 - 2 * xx - 2 * yy, 0.0f);
+
+	SIMD::Float4 s0 = SIMD::Mul(r0, SIMD::Splat(inverseInertia.x));
+	SIMD::Float4 s1 = SIMD::Mul(r1, SIMD::Splat(inverseInertia.y));
+	SIMD::Float4 s2 = SIMD::Mul(r2, SIMD::Splat(inverseInertia.z));
+
+	SIMD::Float4 c0 = SIMD::MulAdd(r2, SIMD::SplatLane<0>(s2), SIMD::MulAdd(r1, SIMD::SplatLane<0>(s1), SIMD::Mul(r0, SIMD::SplatLane<0>(s0))));
+	SIMD::Float4 c1 = SIMD::MulAdd(r2, SIMD::SplatLane<1>(s2), SIMD::MulAdd(r1, SIMD::SplatLane<1>(s1), SIMD::Mul(r0, SIMD::SplatLane<1>(s0))));
+	SIMD::Float4 c2 = SIMD::MulAdd(r2, SIMD::SplatLane<2>(s2), SIMD::MulAdd(r1, SIMD::SplatLane<2>(s1), SIMD::Mul(r0, SIMD::SplatLane<2>(s0))));
+
+	float last[4];
+	SIMD::Store(&inverseInteriaTensor.array[0], c0);
+	SIMD::Store(&inverseInteriaTensor.array[3], c1); // overwrites the padding c0 left behind
+	SIMD::Store(last, c2);
+	inverseInteriaTensor.array[6] = last[0];
+	inverseInteriaTensor.array[7] = last[1];
+	inverseInteriaTensor.array[8] = last[2];
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "../../Common/Vector3.h"
 #include "../../Common/Matrix3.h"
+#include "../../Common/Quaternion.h"
 
 using namespace NCL::Maths;
 
@@ -36,9 +37,7 @@ namespace NCL {
 				return force;
 			}
 
-			void SetInverseMass(float invMass) {
-				inverseMass = invMass;
-			}
+			void SetInverseMass(float invMass);
 
 			float GetInverseMass() const {
 				return inverseMass;
@@ -70,12 +69,28 @@ namespace NCL {
 			void InitCubeInertia();
 			void InitSphereInertia();
 
+			/*
+				Brings the world space inverse inertia tensor up to date with the
+				object's orientation. It's only rebuilt if the object has actually
+				turned since last time, and an object with infinite mass never needs
+				it rebuilding at all, as it can't be turned by anything.
+			*/
 			void UpdateInertiaTensor();
 
-			Matrix3 GetInertiaTensor() const {
+			const Matrix3& GetInertiaTensor() const {
 				return inverseInteriaTensor;
 			}
 
+			/*
+				Objects the LOD skips still collide using the tensor from the last step
+				they moved on, so a snapshot has to keep the orientation it was built for,
+				and build it again for that orientation when it's restored.
+			*/
+			const Quaternion& GetInertiaTensorOrientation() const {
+				return tensorOrientation;
+			}
+			void RestoreInertiaTensor(const Quaternion& orientation);
+
 			void SetElasticity(float e) { this->elasticity = e; }
 			float GetElasticity() { return elasticity; }
 
@@ -102,8 +117,12 @@ namespace NCL {
 			Vector3 torque;
 			Vector3 inverseInertia;
 			Matrix3 inverseInteriaTensor;
+			Quaternion	tensorOrientation;	// the orientation inverseInteriaTensor was built for
+			bool		tensorDirty;		// set when inverseInertia changes
 
 			CollisionType collisionType;
+
+			void BuildInertiaTensor(const Quaternion& q);
 		};
 	}
 }
@@ -3,12 +3,16 @@
 #include "GameObject.h"
 #include "CollisionDetection.h"
 #include "../../Common/Quaternion.h"
+#include "../../Common/PaddedQuaternion.h"
 
 #include "Constraint.h"
+#include "../../Common/GameTimer.h"
 
-#include "Debug.h"
-
+#include <iostream>
 #include <functional>
+#include <unordered_set>
+#include <cstring>
+#include <type_traits>
 using namespace NCL;
 using namespace CSC8503;
 
@@ -19,9 +23,16 @@ PhysicsSystem::PhysicsSystem(GameWorld& g) : gameWorld(g) {
 	globalDamping	= 0.995f;
 	SetGravity(Vector3(0.0f, -9.8f, 0.0f));
 	tree = new NCL::CSC8503::QuadTree<GameObject*>(Vector2(1024.0f, 1024.0f), 7, 6);
+	lodTree = new NCL::CSC8503::QuadTree<GameObject*>(Vector2(1024.0f, 1024.0f), 7, 6);
+	octree = new NCL::CSC8503::Octree<GameObject*>(Vector3(1024.0f, 1024.0f, 1024.0f), 7, 6);
+	workers = new WorkerPool();
 }
 
 PhysicsSystem::~PhysicsSystem()	{
+	delete tree;
+	delete lodTree;
+	delete octree;
+	delete workers;
 }
 
 void PhysicsSystem::SetGravity(const Vector3& g) {
@@ -38,13 +49,15 @@ void PhysicsSystem::SetGravity(const Vector3& g) {
 */
 void PhysicsSystem::Clear() {
 	allCollisions.clear();
+	tree->Clear(); // don't let queries see the objects of a level that's gone
+	lodTree->Clear();
+	lodTreePairs.clear();
+	lodTreeStale = true;
 }
 
 /*
 	This is the core of the physics engine update
 */
-int constraintIterationCount = 10;
-
 //This is the fixed timestep we'd LIKE to have
 const int   idealHZ = 120;
 const float idealDT = 1.0f / idealHZ;
@@ -59,58 +72,127 @@ int realHZ		= idealHZ;
 float realDT	= idealDT;
 
 void PhysicsSystem::Update(float dt) {	
-	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::B)) {
-		useBroadPhase = !useBroadPhase;
-		std::cout << "Setting broadphase to " << useBroadPhase << std::endl;
-	}
-	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::I)) {
-		constraintIterationCount--;
-		std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
-	}
-	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::O)) {
-		constraintIterationCount++;
-		std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
-	}
-
 	dTOffset += dt; // We accumulate time delta here - there might be remainders from previous frame!
 
+	// a deterministic run can't let how long the last update took change the next step
+	const float stepDT			= deterministic ? idealDT : realDT;
+	const float collisionDT		= deterministic ? idealDT : dt;
+	stepHashes.clear();
+
 	GameTimer t;
 	t.GetTimeDeltaSeconds();
 
+	stats = PhysicsStats();
+	GameTimer phaseTimer;
+
+	if (useLOD && !useXPBD) {
+		UpdateLODLevels();
+	}
+	else {
+		bodyLOD.clear(); // otherwise objects would think it's been ages since they last moved
+		lodTreeStale = true;
+	}
 	if (useBroadPhase) {
 		UpdateObjectAABBs();
 	}
+	phaseTimer.Tick();
+	stats.aabbMs += phaseTimer.GetTimeDeltaMSec();
+
+	while(dTOffset >= stepDT) {
+		if (useLOD && !useXPBD) {
+			ScheduleLOD();
+		}
+		if (!useXPBD) { // XPBD applies forces in each substep instead
+			IntegrateAccel(stepDT); // Update accelerations from external forces
+		}
+		phaseTimer.Tick();
+		stats.integrateMs += phaseTimer.GetTimeDeltaMSec();
 
-	while(dTOffset >= realDT) {
-		IntegrateAccel(realDT); // Update accelerations from external forces
 		if (useBroadPhase) {
 			BroadPhase();
-			NarrowPhase(dt);
+			phaseTimer.Tick();
+			stats.broadphaseMs += phaseTimer.GetTimeDeltaMSec();
+		}
+		// contacts are resolved as soon as they're found, so the resolution is timed from inside
+		float resolutionMs = stats.resolutionMs;
+		if (useBroadPhase) {
+			NarrowPhase(collisionDT);
 		}
 		else {
-			BasicCollisionDetection(dt);
+			BasicCollisionDetection(collisionDT);
 		}
+		phaseTimer.Tick();
+		stats.narrowphaseMs += phaseTimer.GetTimeDeltaMSec() - (stats.resolutionMs - resolutionMs);
 
 		/*	This is our simple iterative solver - 
 			we just run things multiple times, slowly moving things forward
-			and then rechecking that the constraints have been met */	
-		float constraintDt = realDT /  (float)constraintIterationCount;
-		for (int i = 0; i < constraintIterationCount; ++i) {
-			UpdateConstraints(constraintDt);	
+			and then rechecking that the constraints have been met.
+			This stays divided by the fixed count even when islands iterate
+			adaptively. The constraints' bias is a velocity every iteration
+			drives towards, not an impulse that adds up, so how hard drift is
+			corrected depends only on this dt. Dividing by each island's own count
+			would make the islands needing the most iterations the stiffest, and
+			that count isn't known until an island has settled anyway. */	
+		float constraintDt = stepDT /  (float)constraintIterations;
+		BeginConstraints();
+		SolveConstraintIslands(constraintDt);
+		EndConstraints();
+		phaseTimer.Tick();
+		stats.constraintMs += phaseTimer.GetTimeDeltaMSec();
+
+		if (useXPBD) {
+			XPBDSubsteps(stepDT);
+			phaseTimer.Tick();
+			stats.constraintMs += phaseTimer.GetTimeDeltaMSec(); // the substeps' integration is part of the solve
+		}
+		else {
+			IntegrateVelocity(stepDT); //update positions from new velocity changes
+			phaseTimer.Tick();
+			stats.integrateMs += phaseTimer.GetTimeDeltaMSec();
 		}
-		IntegrateVelocity(realDT); //update positions from new velocity changes
 
-		dTOffset -= realDT;
+		if (deterministic) {
+			stepHashes.emplace_back(HashState());
+			phaseTimer.Tick(); // checking isn't part of any phase
+		}
+		stats.steps++;
+		lodStep++;
+		queryTreeStale = true;
+		dTOffset -= stepDT;
+	}
+
+	if (useLOD && !useXPBD) { // counted now, as contacts in the steps may have promoted some back to full rate
+		std::vector<GameObject*>::const_iterator first;
+		std::vector<GameObject*>::const_iterator last;
+		gameWorld.GetObjectIterators(first, last);
+		for (auto i = first; i != last; ++i) {
+			if (LODOf(*i).interval > 1) {
+				stats.reducedRateObjects++;
+			}
+		}
 	}
 
 	ClearForces();	//Once we've finished with the forces, reset them to zero
+	phaseTimer.Tick();
+	stats.integrateMs += phaseTimer.GetTimeDeltaMSec();
 
 	UpdateCollisionList(); //Remove any old collisions
+	phaseTimer.Tick();
+	stats.collisionListMs += phaseTimer.GetTimeDeltaMSec();
 
 	t.Tick();
 	float updateTime = t.GetTimeDeltaSeconds();
 
+	stats.totalMs	= updateTime * 1000.0f;
+	stats.stepRate	= deterministic ? idealHZ : realHZ;
+	statsHistory[statsHistoryNext] = stats;
+	statsHistoryNext	= (statsHistoryNext + 1) % (int)statsHistory.size();
+	statsHistoryCount	= std::min(statsHistoryCount + 1, (int)statsHistory.size());
+
 	//Uh oh, physics is taking too long...
+	if (deterministic) {
+		return;
+	}
 	if (updateTime > realDT) {
 		realHZ /= 2;
 		realDT *= 2;
@@ -131,6 +213,256 @@ void PhysicsSystem::Update(float dt) {
 	}
 }
 
+static void HashBytes(uint64_t& hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+/*
+	Hashes the exact bits of each value, so even the last rounding difference
+	between two runs shows up. The objects are hashed in the world's order, which
+	is world ID order in deterministic mode.
+*/
+uint64_t PhysicsSystem::HashState() const {
+	uint64_t hash = 14695981039346656037ull;
+
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	for (auto i = first; i != last; ++i) {
+		const Transform& transform	= (*i)->GetTransform();
+		Vector3		position		= transform.GetPosition();
+		Quaternion	orientation		= transform.GetOrientation();
+		int			worldID			= (*i)->GetWorldID();
+
+		HashBytes(hash, &worldID, sizeof(worldID));
+		HashBytes(hash, &position, sizeof(position));
+		HashBytes(hash, &orientation, sizeof(orientation));
+
+		const PhysicsObject* object = (*i)->GetPhysicsObject();
+		if (object) {
+			Vector3 linear	= object->GetLinearVelocity();
+			Vector3 angular	= object->GetAngularVelocity();
+			HashBytes(hash, &linear, sizeof(linear));
+			HashBytes(hash, &angular, sizeof(angular));
+		}
+	}
+	return hash;
+}
+
+namespace {
+	/*
+		Only plain values go into the buffer - no objects with constructors or
+		destructors - so it can be grown, copied and thrown away like any other
+		bytes, and each value is copied in and out with memcpy, so nothing in it
+		has to be aligned.
+	*/
+	struct SavedVector3 {
+		float x, y, z;
+	};
+	struct SavedQuaternion {
+		float x, y, z, w;
+	};
+
+	struct StateHeader {
+		int		objectCount;	// everything in the world...
+		int		bodyCount;		// ...and the ones with physics, which are all that's saved
+		int		contactCount;
+		int		lodCount;		// the LOD state of every world ID
+		int		lodStep;
+		float	dTOffset;
+	};
+
+	struct BodyState {
+		GameObject*		object;
+		SavedVector3	position;
+		SavedQuaternion	orientation;
+		SavedVector3	scale;
+		SavedVector3	linearVelocity;
+		SavedVector3	angularVelocity;
+		SavedVector3	force;
+		SavedVector3	torque;
+		SavedQuaternion	tensorOrientation;
+		float			inverseMass;
+		bool			active;
+		bool			toDelete;
+	};
+
+	struct ContactState {
+		GameObject*		a;
+		GameObject*		b;
+		int				framesLeft;
+		SavedVector3	localA;
+		SavedVector3	localB;
+		SavedVector3	normal;
+		float			penetration;
+	};
+
+	SavedVector3 Save(const Vector3& v) {
+		return SavedVector3{ v.x, v.y, v.z };
+	}
+	SavedQuaternion Save(const Quaternion& q) {
+		return SavedQuaternion{ q.x, q.y, q.z, q.w };
+	}
+	Vector3 Load(const SavedVector3& v) {
+		return Vector3(v.x, v.y, v.z);
+	}
+	Quaternion Load(const SavedQuaternion& q) {
+		return Quaternion(q.x, q.y, q.z, q.w);
+	}
+
+	template <typename T>
+	void WriteState(char* buffer, size_t& offset, const T& value) {
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be saved");
+		memcpy(buffer + offset, &value, sizeof(T));
+		offset += sizeof(T);
+	}
+
+	// The LOD entries are the system's own type, so their size is passed in
+	size_t StateSize(const StateHeader& header, size_t lodSize) {
+		return sizeof(StateHeader) + sizeof(BodyState) * (size_t)header.bodyCount
+			+ sizeof(ContactState) * (size_t)header.contactCount + lodSize * (size_t)header.lodCount;
+	}
+
+	template <typename T>
+	T ReadState(const char* buffer, size_t& offset) {
+		T value;
+		memcpy(&value, buffer + offset, sizeof(T));
+		offset += sizeof(T);
+		return value;
+	}
+}
+
+void PhysicsSystem::SaveState(std::vector<char>& buffer) const {
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+
+	StateHeader header;
+	header.objectCount	= (int)(last - first);
+	header.bodyCount	= (int)std::count_if(first, last, [](GameObject* o) { return o->GetPhysicsObject() != nullptr; });
+	header.contactCount	= (int)allCollisions.size();
+	header.lodCount		= (int)bodyLOD.size();
+	header.lodStep		= lodStep;
+	header.dTOffset		= dTOffset;
+
+	// exactly the size RestoreState checks for - shrinking keeps the capacity, so this only allocates when it grows
+	buffer.resize(StateSize(header, sizeof(BodyLOD)));
+	char* data		= buffer.data();
+	size_t offset	= 0;
+	WriteState(data, offset, header);
+
+	for (auto i = first; i != last; ++i) {
+		GameObject* o					= *i;
+		const PhysicsObject* physics	= o->GetPhysicsObject();
+		if (!physics) {
+			continue;
+		}
+		const Transform& transform = o->GetTransform();
+
+		BodyState body;
+		body.object				= o;
+		body.position			= Save(transform.GetPosition());
+		body.orientation		= Save(transform.GetOrientation());
+		body.scale				= Save(transform.GetScale());
+		body.linearVelocity		= Save(physics->GetLinearVelocity());
+		body.angularVelocity	= Save(physics->GetAngularVelocity());
+		body.force				= Save(physics->GetForce());
+		body.torque				= Save(physics->GetTorque());
+		body.tensorOrientation	= Save(physics->GetInertiaTensorOrientation());
+		body.inverseMass		= physics->GetInverseMass();
+		body.active				= o->IsActive();
+		body.toDelete			= o->isToDelete();
+		WriteState(data, offset, body);
+	}
+
+	for (const CollisionDetection::CollisionInfo& info : allCollisions) {
+		ContactState contact;
+		contact.a			= info.a;
+		contact.b			= info.b;
+		contact.framesLeft	= info.framesLeft;
+		contact.localA		= Save(info.point.localA);
+		contact.localB		= Save(info.point.localB);
+		contact.normal		= Save(info.point.normal);
+		contact.penetration	= info.point.penetration;
+		WriteState(data, offset, contact);
+	}
+
+	// without these, reduced rate objects would be scheduled on different steps after restoring
+	for (const BodyLOD& lod : bodyLOD) {
+		WriteState(data, offset, lod);
+	}
+}
+
+bool PhysicsSystem::RestoreState(const std::vector<char>& buffer) {
+	if (buffer.size() < sizeof(StateHeader)) {
+		return false;
+	}
+	const char* data	= buffer.data();
+	size_t offset		= 0;
+	StateHeader header	= ReadState<StateHeader>(data, offset);
+	if (header.bodyCount < 0 || header.contactCount < 0 || header.lodCount < 0 || buffer.size() != StateSize(header, sizeof(BodyLOD))) {
+		return false; // truncated, or not a snapshot at all
+	}
+
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	if (header.objectCount != (int)(last - first)) {
+		return false;
+	}
+
+	for (int i = 0; i < header.bodyCount; ++i) {
+		BodyState body			= ReadState<BodyState>(data, offset);
+		PhysicsObject* physics	= body.object->GetPhysicsObject();
+
+		body.object->GetTransform()
+			.SetPosition(Load(body.position))
+			.SetOrientation(Load(body.orientation))
+			.SetScale(Load(body.scale));
+
+		physics->SetLinearVelocity(Load(body.linearVelocity));
+		physics->SetAngularVelocity(Load(body.angularVelocity));
+		physics->ClearForces();
+		physics->AddForce(Load(body.force));
+		physics->AddTorque(Load(body.torque));
+		if (physics->GetInverseMass() != body.inverseMass) {
+			physics->SetInverseMass(body.inverseMass);
+		}
+		physics->RestoreInertiaTensor(Load(body.tensorOrientation));
+		body.object->SetIsActive(body.active);
+		body.object->setToDelete(body.toDelete);
+	}
+
+	// the set has to allocate a node per contact, but there are only ever a handful
+	allCollisions.clear();
+	for (int i = 0; i < header.contactCount; ++i) {
+		ContactState contact = ReadState<ContactState>(data, offset);
+
+		CollisionDetection::CollisionInfo info;
+		info.a			= contact.a;
+		info.b			= contact.b;
+		info.framesLeft	= contact.framesLeft;
+		info.AddContactPoint(Load(contact.localA), Load(contact.localB), Load(contact.normal), contact.penetration);
+		allCollisions.insert(info);
+	}
+
+	bodyLOD.resize(header.lodCount);
+	for (BodyLOD& lod : bodyLOD) {
+		lod = ReadState<BodyLOD>(data, offset);
+	}
+	lodStep = header.lodStep;
+
+	dTOffset		= header.dTOffset;
+	queryTreeStale	= true;
+	lodAABBStep		= -1; // everything may have turned
+	lodTreeStale	= true;
+	return true;
+}
+
 /*
 	Later on we're going to need to keep track of collisions
 	across multiple frames, so we store them in a set.
@@ -160,30 +492,73 @@ void PhysicsSystem::UpdateCollisionList() {
 	}
 }
 
+// With the LOD on, objects that haven't moved since the last refresh can't have turned either
 void PhysicsSystem::UpdateObjectAABBs() {
 	std::vector <GameObject*>::const_iterator first;
 	std::vector <GameObject*>::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
+	bool skipResting = useLOD && !useXPBD && lodAABBStep >= 0;
 	for (auto i = first; i != last; ++i) {
+		if (skipResting) {
+			const BodyLOD& lod = LODOf(*i);
+			if (lod.lastStep >= 0 && lod.lastStep < lodAABBStep) {
+				continue;
+			}
+		}
 		(*i)->UpdateBroadphaseAABB();
 	}
+	lodAABBStep = (useLOD && !useXPBD) ? lodStep : -1;
 }
 
-std::set<CollisionDetection::CollisionInfo>* PhysicsSystem::PotentialCollisionsFromRay(Ray& r) {
-	std::set<CollisionDetection::CollisionInfo>* potentialCollisionsToRay = new std::set<CollisionDetection::CollisionInfo>();
+bool PhysicsSystem::Raycast(Ray& r, RayCollision& closestCollision, GameObject* ignoreGO) {
+	if (!useBroadPhase || broadPhaseStructure != BroadPhaseStructure::QuadTree) {
+		return gameWorld.Raycast(r, closestCollision, true, ignoreGO);
+	}
+	// candidates come back sorted by where the ray enters their broadphase box
+	RefreshQueryTree();
+	tree->RayQuery(r, queryResults);
+
+	RayCollision collision;
+	for (auto& i : queryResults) {
+		if (i.distance > collision.rayDistance) {
+			break; // everything else starts further away than the closest hit so far
+		}
+		if (i.object == ignoreGO) {
+			continue;
+		}
+		RayCollision thisCollision;
+		if (CollisionDetection::RayIntersection(r, *i.object, thisCollision) && thisCollision.rayDistance < collision.rayDistance) {
+			thisCollision.node	= i.object;
+			collision			= thisCollision;
+		}
+	}
+	if (collision.node) {
+		closestCollision = collision;
+		return true;
+	}
+	return false;
+}
 
-	tree->OperateOnContents(
-		[&](std::list <QuadTreeEntry<GameObject*>>& data) {
-			CollisionDetection::CollisionInfo info;
-			for (auto i = data.begin(); i != data.end(); ++i) {
-				
-				// perform Raycast functionality in here
-				// if true, add to potentialCollisionsToRay set
+GameObject* PhysicsSystem::NearestObject(const Vector3& position, std::function<bool(GameObject*)> filter) {
+	if (!useBroadPhase || broadPhaseStructure != BroadPhaseStructure::QuadTree) {
+		GameObject* nearest		= nullptr;
+		float nearestDistance	= FLT_MAX;
+
+		std::vector <GameObject*>::const_iterator first;
+		std::vector <GameObject*>::const_iterator last;
+		gameWorld.GetObjectIterators(first, last);
+		for (auto i = first; i != last; ++i) {
+			float distance = ((*i)->GetTransform().GetPosition() - position).LengthSquared();
+			if (distance < nearestDistance && filter(*i)) {
+				nearest			= *i;
+				nearestDistance = distance;
 			}
 		}
-	);
-	
-	return potentialCollisionsToRay;
+		return nearest;
+	}
+	RefreshQueryTree();
+	tree->NearestNeighbours(position, 1, queryResults, filter);
+	return queryResults.empty() ? nullptr : queryResults[0].object;
 }
 
 
@@ -194,6 +569,10 @@ std::set<CollisionDetection::CollisionInfo>* PhysicsSystem::PotentialCollisionsF
 	a particular pair will only be added once, so objects colliding for
 	multiple frames won't flood the set with duplicates.
 */
+static float MSecSince(const Timepoint& start) {
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 void PhysicsSystem::BasicCollisionDetection(float dt) {
 	std::vector <GameObject*>::const_iterator first;
 	std::vector <GameObject*>::const_iterator last;
@@ -208,9 +587,17 @@ void PhysicsSystem::BasicCollisionDetection(float dt) {
 				continue;
 			}
 
+			if (SkipLODPair(*i, *j)) {
+				continue;
+			}
+			stats.broadphasePairs++;
 			CollisionDetection::CollisionInfo info;
 			if (CollisionDetection::ObjectIntersection(*i, *j, info)) {
+				stats.contacts++;
+				PromoteLOD(info.a, info.b);
+				Timepoint start = std::chrono::high_resolution_clock::now();
 				ImpulseResolveCollision(*info.a, *info.b, info.point);
+				stats.resolutionMs += MSecSince(start);
 				//ResolveSpringCollision(*info.a, *info.b, info.point, dt); // impulse or spring collision
 				info.framesLeft = numCollisionFrames;
 				allCollisions.insert(info);
@@ -325,39 +712,211 @@ void PhysicsSystem::ResolveSpringCollision(GameObject& a, GameObject& b, Collisi
 	Splitting the world up using an acceleration structure for the broadphase, so
 	that we can only compare collisions we absolutely need to.
 */
+// The lower world ID always goes first, so pairs don't depend on where the objects were allocated
+static void OrderPair(CollisionDetection::CollisionInfo& info, GameObject* a, GameObject* b) {
+	bool swap	= b->GetWorldID() < a->GetWorldID();
+	info.a		= swap ? b : a;
+	info.b		= swap ? a : b;
+}
+
 void PhysicsSystem::BroadPhase() {
 
-	// Constructing a Quadtree with some default parameters, then iterating through all of the objects in the game world and inserting them into the tree
+	// Constructing a Quadtree (or Octree) with some default parameters, then iterating through all of the objects in the game world and inserting them into the tree
 	broadphaseCollisions.clear();
-	delete tree;
-	tree = new NCL::CSC8503::QuadTree<GameObject*>(Vector2(1024.0f, 1024.0f), 7, 6);
+	if (useLOD && !useXPBD && broadPhaseStructure == BroadPhaseStructure::QuadTree) {
+		LODBroadPhase();
+		return;
+	}
+	if (broadPhaseStructure == BroadPhaseStructure::Octree) {
+		delete octree;
+		octree = new NCL::CSC8503::Octree<GameObject*>(Vector3(1024.0f, 1024.0f, 1024.0f), 7, 6);
+	}
+	else {
+		BuildQuadTree();
+	}
 	
+	CollisionDetection::CollisionInfo info;
+	if (broadPhaseStructure == BroadPhaseStructure::Octree) {
+		std::vector <GameObject*>::const_iterator first;
+		std::vector <GameObject*>::const_iterator last;
+		gameWorld.GetObjectIterators(first, last);
+		for (auto i = first; i != last; ++i) {
+			Vector3 halfSizes;
+			if ((*i)->GetBroadphaseAABB(halfSizes)) {
+				octree->Insert(*i, (*i)->GetTransform().GetPosition(), halfSizes);
+			}
+		}
+
+		// every object lives in exactly one octree node, so pairs have to come from the tree itself
+		octree->OperateOnPairs(
+			[&](OctreeEntry<GameObject*>& i, OctreeEntry<GameObject*>& j) {
+				OrderPair(info, i.object, j.object);
+				broadphaseCollisions.push_back(info);
+			}
+		);
+		return;
+	}
+
+	// objects can be in several quadtree nodes, but each pair is only reported from one of them
+	tree->OperateOnPairs(
+		[&](QuadTreeEntry<GameObject*>& i, QuadTreeEntry<GameObject*>& j) {
+			OrderPair(info, i.object, j.object);
+			broadphaseCollisions.push_back(info);
+		}
+	);
+}
+
+// Keeps its node and entry pools, so rebuilding doesn't allocate
+void PhysicsSystem::BuildQuadTree() {
+	tree->Clear();
+
 	std::vector <GameObject*>::const_iterator first;
 	std::vector <GameObject*>::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
 	for (auto i = first; i != last; ++i) {
 		Vector3 halfSizes;
-		if (!(*i)->GetBroadphaseAABB(halfSizes)) {
+		if ((*i)->GetBroadphaseAABB(halfSizes)) {
+			tree->Insert(*i, (*i)->GetTransform().GetPosition(), halfSizes);
+		}
+	}
+	queryTreeStale = false;
+}
+
+namespace {
+	bool BroadphaseBoxesOverlap(GameObject* a, GameObject* b) {
+		Vector3 sizeA;
+		Vector3 sizeB;
+		a->GetBroadphaseAABB(sizeA);
+		b->GetBroadphaseAABB(sizeB);
+		return CollisionDetection::AABBTest(a->GetTransform().GetPosition(), b->GetTransform().GetPosition(), sizeA, sizeB);
+	}
+
+	bool PairBefore(const std::pair<GameObject*, GameObject*>& a, const std::pair<GameObject*, GameObject*>& b) {
+		if (a.first->GetWorldID() != b.first->GetWorldID()) {
+			return a.first->GetWorldID() < b.first->GetWorldID();
+		}
+		return a.second->GetWorldID() < b.second->GetWorldID();
+	}
+}
+
+/*
+	With the LOD on, most objects aren't due on any given step, and haven't moved
+	since they last were. The reduced rate objects are kept in lodTree between
+	steps, each with room to move, so only the full rate objects (and any that have
+	dropped to a reduced rate since lodTree was built) go in the tree each step,
+	and look themselves up in lodTree. lodTree, and the pairs within it, only change
+	once one of its objects has left its box or the world's objects have changed.
+
+	Pairs are only kept if one of the objects is due and their actual boxes
+	overlap, and are then sorted, so which pairs get resolved, and in what order,
+	doesn't depend on when lodTree happened to be built.
+*/
+void PhysicsSystem::LODBroadPhase() {
+	std::vector <GameObject*>::const_iterator first;
+	std::vector <GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+
+	bool rebuild = lodTreeStale || lodStep - lodTreeStep >= lodTreeSteps || gameWorld.GetObjectVersion() != lodTreeObjectVersion;
+	for (auto i = first; i != last && !rebuild; ++i) {
+		Vector3 halfSizes;
+		const LODTreeBox& box = LODTreeBoxOf(*i);
+		if (box.cached && (*i)->GetBroadphaseAABB(halfSizes)) {
+			rebuild = !box.Contains((*i)->GetTransform().GetPosition(), halfSizes);
+		}
+	}
+	if (rebuild) {
+		BuildLODTree();
+	}
+
+	tree->Clear();
+	for (auto i = first; i != last; ++i) {
+		Vector3 halfSizes;
+		if ((*i)->GetBroadphaseAABB(halfSizes) && !InLODTree(*i)) {
+			tree->Insert(*i, (*i)->GetTransform().GetPosition(), halfSizes);
+		}
+	}
+	queryTreeStale = true; // it's missing everything in lodTree
+
+	lodStepPairs.clear();
+	tree->OperateOnPairs(
+		[&](QuadTreeEntry<GameObject*>& i, QuadTreeEntry<GameObject*>& j) {
+			if (!SkipLODPair(i.object, j.object) && CollisionDetection::AABBTest(i.pos, j.pos, i.size, j.size)) {
+				lodStepPairs.emplace_back(i.object, j.object);
+			}
+		}
+	);
+	for (auto i = first; i != last; ++i) {
+		Vector3 halfSizes;
+		if (!(*i)->GetBroadphaseAABB(halfSizes) || InLODTree(*i)) {
 			continue;
 		}
-		Vector3 pos = (*i)->GetTransform().GetPosition();
-		tree->Insert(*i, pos, halfSizes);
+		lodTree->RangeQuery((*i)->GetTransform().GetPosition(), halfSizes, lodQueryResults);
+		for (GameObject* o : lodQueryResults) {
+			if (InLODTree(o) && !SkipLODPair(*i, o) && BroadphaseBoxesOverlap(*i, o)) {
+				lodStepPairs.emplace_back(*i, o);
+			}
+		}
+	}
+	for (auto& i : lodTreePairs) {
+		if (InLODTree(i.first) && InLODTree(i.second) && !SkipLODPair(i.first, i.second) && BroadphaseBoxesOverlap(i.first, i.second)) {
+			lodStepPairs.emplace_back(i);
+		}
 	}
 
-	tree->OperateOnContents(
-		 [&](std::list < QuadTreeEntry <GameObject*>>& data) {
-			CollisionDetection::CollisionInfo info;
-			for (auto i = data.begin(); i != data.end(); ++i) {
-				for (auto j = std::next(i); j != data.end(); ++j) {
-					// is this pair of items already in the collision set -
-					// if the same pair is in another quadtree node together etc
-					info.a = min((*i).object, (*j).object);
-					info.b = max((*i).object, (*j).object);
-					broadphaseCollisions.insert(info);
-				}
+	CollisionDetection::CollisionInfo info;
+	for (auto& i : lodStepPairs) {
+		OrderPair(info, i.first, i.second);
+		i = std::make_pair(info.a, info.b);
+	}
+	std::sort(lodStepPairs.begin(), lodStepPairs.end(), PairBefore);
+	for (auto& i : lodStepPairs) {
+		info.a = i.first;
+		info.b = i.second;
+		broadphaseCollisions.push_back(info);
+	}
+}
+
+// Each box is grown by how far its object could get before lodTree is next due to be rebuilt anyway
+void PhysicsSystem::BuildLODTree() {
+	lodTree->Clear();
+	lodTreePairs.clear();
+
+	std::vector <GameObject*>::const_iterator first;
+	std::vector <GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	float time = lodTreeSteps * idealDT;
+	for (auto i = first; i != last; ++i) {
+		Vector3 halfSizes;
+		LODTreeBox& box = LODTreeBoxOf(*i);
+		box.cached = LODOf(*i).interval > 1 && (*i)->GetBroadphaseAABB(halfSizes);
+		if (!box.cached) {
+			continue;
+		}
+		float speed		= (*i)->GetPhysicsObject()->GetLinearVelocity().Length();
+		float margin	= speed * time + 0.5f * gravity.Length() * time * time + lodTreeSlack;
+		box.position	= (*i)->GetTransform().GetPosition();
+		box.halfSize	= halfSizes + Vector3(margin, margin, margin);
+		lodTree->Insert(*i, box.position, box.halfSize);
+	}
+	lodTree->OperateOnPairs(
+		[&](QuadTreeEntry<GameObject*>& i, QuadTreeEntry<GameObject*>& j) {
+			if (CollisionDetection::AABBTest(i.pos, j.pos, i.size, j.size)) {
+				lodTreePairs.emplace_back(i.object, j.object);
 			}
 		}
 	);
+	lodTreeStep				= lodStep;
+	lodTreeObjectVersion	= gameWorld.GetObjectVersion();
+	lodTreeStale			= false;
+	stats.lodTreeBuilds++;
+}
+
+// Objects will have moved on since the last broadphase built the tree, so queries rebuild it once first
+void PhysicsSystem::RefreshQueryTree() {
+	if (queryTreeStale) {
+		UpdateObjectAABBs();
+		BuildQuadTree();
+	}
 }
 
 /*
@@ -365,18 +924,26 @@ void PhysicsSystem::BroadPhase() {
 	and work out if they are truly colliding, and if so, add them into the main collision list
 */
 void PhysicsSystem::NarrowPhase(float dt) {
-	for (std::set <CollisionDetection::CollisionInfo>::iterator
+	stats.broadphasePairs += (int)broadphaseCollisions.size();
+	for (std::vector <CollisionDetection::CollisionInfo>::iterator
 		i = broadphaseCollisions.begin();
 		i != broadphaseCollisions.end(); ++i) {
 		CollisionDetection::CollisionInfo info = *i;
+		if (SkipLODPair(info.a, info.b)) {
+			continue;
+		}
 		if (CollisionDetection::ObjectIntersection(info.a, info.b, info)) {
+			stats.contacts++;
+			PromoteLOD(info.a, info.b);
 			info.framesLeft = numCollisionFrames;
+			Timepoint start = std::chrono::high_resolution_clock::now();
 			if (info.a->GetPhysicsObject()->GetCollisionType() == CollisionType::Spring || info.b->GetPhysicsObject()->GetCollisionType() == CollisionType::Spring) {
 				ResolveSpringCollision(*info.a, *info.b, info.point, dt);
 			}
 			else {
 				ImpulseResolveCollision(*info.a, *info.b, info.point);
 			}
+			stats.resolutionMs += MSecSince(start);
 			allCollisions.insert(info); // insert into our main set
 		}
 	}
@@ -391,7 +958,7 @@ void PhysicsSystem::NarrowPhase(float dt) {
 	based on any forces that have been accumulated in the objects during
 	the course of the previous game frame.
 */
-void PhysicsSystem::IntegrateAccel(float dt) {
+void PhysicsSystem::IntegrateAccel(float stepDt) {
 	std::vector < GameObject* >::const_iterator first;
 	std::vector < GameObject* >::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
@@ -401,6 +968,11 @@ void PhysicsSystem::IntegrateAccel(float dt) {
 		if (object == nullptr) {
 			continue; // No physics object for this GameObject !
 		}
+		int steps = useLOD ? LODSteps(*i) : 1;
+		if (steps == 0) {
+			continue;
+		}
+		float dt = stepDt * steps;
 
 		float inverseMass = object->GetInverseMass();
 
@@ -429,44 +1001,55 @@ void PhysicsSystem::IntegrateAccel(float dt) {
 		object->SetAngularVelocity(angVel);
 	}
 }
+namespace {
+	// Every moving object does this every step, so it's done in SIMD registers
+	Quaternion IntegrateOrientation(const Quaternion& orientation, const Vector3& angVel, float dt) {
+		PaddedQuaternion q(orientation);
+		PaddedQuaternion spin(PaddedVector3(angVel * (dt * 0.5f)), 0.0f);
+		return (q + spin * q).Normalised().ToQuaternion();
+	}
+}
+
 /*
 	This function integrates linear and angular velocity into
 	position and orientation. It may be called multiple times
 	throughout a physics update, to slowly move the objects through
 	the world, looking for collisions.
 */
-void PhysicsSystem::IntegrateVelocity(float dt) {
+void PhysicsSystem::IntegrateVelocity(float stepDt) {
 	std::vector <GameObject*>::const_iterator first;
 	std::vector <GameObject*>::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
-	float frameLinearDamping = 1.0f - (linearDamping * dt);
 
 	for (auto i = first; i != last; ++i) {
 		PhysicsObject* object = (*i)->GetPhysicsObject();
 		if (object == nullptr) {
 			continue;
 		}
+		int steps = 1;
+		if (useLOD) {
+			steps = LODSteps(*i);
+			if (steps == 0) {
+				continue;
+			}
+			LODOf(*i).lastStep = lodStep;
+		}
+		float dt					= stepDt * steps;
+		float frameLinearDamping	= 1.0f - (linearDamping * dt);
 		Transform& transform = (*i)->GetTransform();
 
 		// Position Stuff
 		Vector3 position = transform.GetPosition();
 		Vector3 linearVel = object->GetLinearVelocity();
-		position += linearVel * dt;
-		transform.SetPosition(position);
+		transform.SetPosition(Maths::MulAdd(linearVel, dt, position));
 
 		// Linear Damping
 		linearVel = linearVel * frameLinearDamping;
 		object->SetLinearVelocity(linearVel);
 
 		// Orientation Stuff
-		Quaternion orientation = transform.GetOrientation();
 		Vector3 angVel = object->GetAngularVelocity();
-		
-		// Integration
-		orientation = orientation + (Quaternion(angVel * dt * 0.5f, 0.0f) * orientation);
-		orientation.Normalise();
-		
-		transform.SetOrientation(orientation);
+		transform.SetOrientation(IntegrateOrientation(transform.GetOrientation(), angVel, dt));
 		
 		// Damp the angular velocity too
 		float frameAngularDamping = 1.0f - (0.4f * dt);
@@ -476,6 +1059,104 @@ void PhysicsSystem::IntegrateVelocity(float dt) {
 	}
 }
 
+PhysicsSystem::BodyLOD& PhysicsSystem::LODOf(const GameObject* o) {
+	size_t id = (size_t)o->GetWorldID();
+	if (id >= bodyLOD.size()) {
+		bodyLOD.resize(id + 1);
+	}
+	return bodyLOD[id];
+}
+
+PhysicsSystem::LODTreeBox& PhysicsSystem::LODTreeBoxOf(const GameObject* o) {
+	size_t id = (size_t)o->GetWorldID();
+	if (id >= lodTreeBoxes.size()) {
+		lodTreeBoxes.resize(id + 1);
+	}
+	return lodTreeBoxes[id];
+}
+
+// Works out how often each object should be updated, from how far it is from the nearest focus point
+void PhysicsSystem::UpdateLODLevels() {
+	if (gameWorld.GetConstraintVersion() != lodConstraintVersion) {
+		std::vector<Constraint*>::const_iterator first;
+		std::vector<Constraint*>::const_iterator last;
+		gameWorld.GetConstraintIterators(first, last);
+
+		std::vector<GameObject*> bodies;
+		for (auto i = first; i != last; ++i) {
+			(*i)->GetBodies(bodies);
+		}
+		constrainedBodies.clear();
+		constrainedBodies.insert(bodies.begin(), bodies.end());
+		lodConstraintVersion = gameWorld.GetConstraintVersion();
+	}
+
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+
+	for (auto i = first; i != last; ++i) {
+		BodyLOD& lod			= LODOf(*i);
+		PhysicsObject* object	= (*i)->GetPhysicsObject();
+		lod.interval = 1;
+
+		if (lodFocus.empty() || !object || lod.fullRateUntil > lodStep || constrainedBodies.count(*i) ||
+			object->GetForce().LengthSquared() > 0.0f || object->GetTorque().LengthSquared() > 0.0f) {
+			continue;
+		}
+		Vector3 position	= (*i)->GetTransform().GetPosition();
+		float nearest		= FLT_MAX;
+		for (const Vector3& focus : lodFocus) {
+			nearest = std::min(nearest, (position - focus).LengthSquared());
+		}
+		for (int level = 2; level >= 0; --level) {
+			if (nearest > lodDistances[level] * lodDistances[level]) {
+				lod.interval = 2 << level;
+				break;
+			}
+		}
+	}
+}
+
+// Picks out the objects due to move this step - the world ID spreads those at the same rate over different steps
+void PhysicsSystem::ScheduleLOD() {
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+
+	for (auto i = first; i != last; ++i) {
+		BodyLOD& lod = LODOf(*i);
+		lod.due = (lod.interval == 1) || ((lodStep + (*i)->GetWorldID()) % lod.interval == 0);
+	}
+}
+
+// How many steps' worth of time the object should move on by this step - 0 if it isn't due
+int PhysicsSystem::LODSteps(const GameObject* o) {
+	const BodyLOD& lod = LODOf(o);
+	if (!lod.due) {
+		return 0;
+	}
+	return (lod.lastStep < 0) ? 1 : lodStep - lod.lastStep;
+}
+
+// Something at full rate touching something that isn't brings it up to full rate too
+void PhysicsSystem::PromoteLOD(const GameObject* a, const GameObject* b) {
+	if (!useLOD) {
+		return;
+	}
+	LODOf(a); // so that fetching b can't move a's entry from under us
+	BodyLOD& lodB = LODOf(b);
+	BodyLOD& lodA = LODOf(a);
+	if (lodA.interval == 1 && lodB.interval > 1) {
+		lodB.interval		= 1;
+		lodB.fullRateUntil	= lodStep + lodPromotionSteps;
+	}
+	else if (lodB.interval == 1 && lodA.interval > 1) {
+		lodA.interval		= 1;
+		lodA.fullRateUntil	= lodStep + lodPromotionSteps;
+	}
+}
+
 /*
 	Once we're finished with a physics update, we have to
 	clear out any accumulated forces, ready to receive new
@@ -494,12 +1175,393 @@ void PhysicsSystem::ClearForces() {
 	to constrain objects based on some extra calculation, allowing
 	us to model springs and ropes etc. 
 */
+void PhysicsSystem::SolveConstraintIslands(float dt) {
+	int maxIterations	= adaptiveIterations ? maxSolverIterations : constraintIterations;
+	int fixedIterations	= std::min(constraintIterations, maxIterations);
+
+	for (ConstraintIsland& island : islands) {
+		island.iterations	= 0;
+		island.fixedCount	= false;
+	}
+	std::fill(islandActive.begin(), islandActive.end(), 1);
+	int activeCount = (int)islands.size();
+
+	for (int i = 0; i < maxIterations && activeCount > 0; ++i) {
+		UpdateConstraints(dt);
+		UpdateIslandResiduals();
+
+		activeCount = 0;
+		for (size_t j = 0; j < islands.size(); ++j) {
+			if (!islandActive[j]) {
+				continue;
+			}
+			ConstraintIsland& island = islands[j];
+			island.iterations++;
+
+			bool settled = false;
+			if (!adaptiveIterations || island.fixedCount) {
+				settled = island.iterations >= fixedIterations;
+			}
+			else {
+				settled = island.iterations >= minSolverIterations && island.residual <= solverTolerance;
+			}
+			if (settled) {
+				islandActive[j] = 0;
+			}
+			else {
+				activeCount++;
+			}
+		}
+	}
+	for (const ConstraintIsland& island : islands) {
+		stats.constraintIterations = std::max(stats.constraintIterations, island.iterations);
+	}
+}
+
+// One iteration over every constraint whose island hasn't settled yet
 void PhysicsSystem::UpdateConstraints(float dt) {
-	std::vector<Constraint*>::const_iterator first;
-	std::vector<Constraint*>::const_iterator last;
-	gameWorld.GetConstraintIterators(first, last);
+	const char* active = islandActive.data();
+
+	for (int i = 0; i < positionRows.GetBatchCount(); ++i) {
+		int start	= positionRows.GetBatchStart(i);
+		int count	= positionRows.GetBatchEnd(i) - start;
+		if (parallelConstraints && positionRows.IsParallelBatch(i) && count >= minParallelBatch) {
+			workers->ParallelFor(count,
+				[&](int begin, int end) {
+					positionRows.SolveRows(start + begin, start + end, dt, active);
+				}, minParallelBatch / 2
+			);
+		}
+		else {
+			positionRows.SolveRows(start, start + count, dt, active);
+		}
+	}
+
+	for (int i = 0; i < constraintBatcher.GetBatchCount(); ++i) {
+		const std::vector<Constraint*>& batch	= constraintBatcher.GetBatch(i);
+		const std::vector<int>& islandOf		= batchIslands[i];
+		if (parallelConstraints && (int)batch.size() >= minParallelBatch) {
+			// nothing in a batch shares an object, so each thread can safely take a slice of it
+			workers->ParallelFor((int)batch.size(),
+				[&](int begin, int end) {
+					for (int j = begin; j < end; ++j) {
+						if (active[islandOf[j]]) {
+							batch[j]->UpdateConstraint(dt);
+						}
+					}
+				}, minParallelBatch / 2
+			);
+		}
+		else {
+			SolveConstraints(batch, islandOf, dt);
+		}
+	}
+	SolveConstraints(constraintBatcher.GetSerialBatch(), serialBatchIslands, dt);
+}
+
+void PhysicsSystem::SolveConstraints(const std::vector<Constraint*>& batch, const std::vector<int>& islandOf, float dt) {
+	for (size_t i = 0; i < batch.size(); ++i) {
+		if (islandActive[islandOf[i]]) {
+			batch[i]->UpdateConstraint(dt);
+		}
+	}
+}
+
+// Each island's residual is the largest error any of its constraints had this iteration
+void PhysicsSystem::UpdateIslandResiduals() {
+	for (size_t i = 0; i < islands.size(); ++i) {
+		if (islandActive[i]) {
+			islands[i].residual = 0.0f;
+		}
+	}
+	for (int r = 0; r < positionRows.GetRowCount(); ++r) {
+		int island = positionRows.GetRowIsland(r);
+		if (islandActive[island]) {
+			islands[island].residual = std::max(islands[island].residual, positionRows.GetRowResidual(r));
+		}
+	}
+	auto addResiduals = [&](const std::vector<Constraint*>& batch, const std::vector<int>& islandOf) {
+		for (size_t i = 0; i < batch.size(); ++i) {
+			ConstraintIsland& island = islands[islandOf[i]];
+			if (!islandActive[islandOf[i]]) {
+				continue;
+			}
+			float residual = batch[i]->GetResidual();
+			if (residual < 0.0f) {
+				island.fixedCount = true;
+			}
+			else {
+				island.residual = std::max(island.residual, residual);
+			}
+		}
+	};
+	for (int i = 0; i < constraintBatcher.GetBatchCount(); ++i) {
+		addResiduals(constraintBatcher.GetBatch(i), batchIslands[i]);
+	}
+	addResiduals(constraintBatcher.GetSerialBatch(), serialBatchIslands);
+}
+
+/*
+	PositionConstraints are moved into positionRows, unless one of their objects is
+	also used by some other kind of constraint. The rows only see their objects'
+	velocities as they were at the start of the step, so anything else changing
+	those objects mid-solve would be lost.
+*/
+void PhysicsSystem::BuildConstraintBatches() {
+	std::vector<Constraint*>::const_iterator worldFirst;
+	std::vector<Constraint*>::const_iterator worldLast;
+	gameWorld.GetConstraintIterators(worldFirst, worldLast);
+
+	// in XPBD mode, anything that can solve positions is only solved in the substeps
+	std::vector<Constraint*> positional;
+	std::vector<Constraint*> velocity;
+	for (auto i = worldFirst; i != worldLast; ++i) {
+		if (useXPBD && (*i)->CanSolvePositions()) {
+			positional.emplace_back(*i);
+		}
+		else {
+			velocity.emplace_back(*i);
+		}
+	}
+	positionalBatcher.Build(positional.begin(), positional.end());
+
+	std::vector<Constraint*>::const_iterator first	= velocity.begin();
+	std::vector<Constraint*>::const_iterator last	= velocity.end();
+
+	std::vector<Constraint*> rowConstraints;
+	std::vector<Constraint*> otherConstraints;
+
+	if (contiguousConstraints) {
+		std::unordered_set<GameObject*> sharedBodies;
+		std::vector<GameObject*> bodies;
+		bool unknownBodies = false;
+		for (auto i = first; i != last; ++i) {
+			if (dynamic_cast<PositionConstraint*>(*i)) {
+				continue;
+			}
+			bodies.clear();
+			(*i)->GetBodies(bodies);
+			unknownBodies |= bodies.empty();
+			sharedBodies.insert(bodies.begin(), bodies.end());
+		}
+		for (auto i = first; i != last; ++i) {
+			PositionConstraint* p = dynamic_cast<PositionConstraint*>(*i);
+			if (p && !unknownBodies && !sharedBodies.count(p->GetObjectA()) && !sharedBodies.count(p->GetObjectB())) {
+				rowConstraints.emplace_back(p);
+			}
+			else {
+				otherConstraints.emplace_back(*i);
+			}
+		}
+	}
+	else {
+		otherConstraints.assign(first, last);
+	}
+
+	std::unordered_map<Constraint*, int> islandOf;
+	BuildConstraintIslands(first, last, islandOf);
+
+	auto islandsOf = [&](const std::vector<Constraint*>& batch) {
+		std::vector<int> result;
+		for (Constraint* c : batch) {
+			result.emplace_back(islandOf[c]);
+		}
+		return result;
+	};
+
+	ConstraintBatcher rowBatcher;
+	rowBatcher.Build(rowConstraints.begin(), rowConstraints.end());
+	positionRows.Clear();
+	for (int i = 0; i < rowBatcher.GetBatchCount(); ++i) {
+		positionRows.AddBatch(rowBatcher.GetBatch(i), islandsOf(rowBatcher.GetBatch(i)), true);
+	}
+	positionRows.AddBatch(rowBatcher.GetSerialBatch(), islandsOf(rowBatcher.GetSerialBatch()), false);
+
+	constraintBatcher.Build(otherConstraints.begin(), otherConstraints.end());
+	batchIslands.clear();
+	for (int i = 0; i < constraintBatcher.GetBatchCount(); ++i) {
+		batchIslands.emplace_back(islandsOf(constraintBatcher.GetBatch(i)));
+	}
+	serialBatchIslands = islandsOf(constraintBatcher.GetSerialBatch());
+
+	batchedConstraintVersion = gameWorld.GetConstraintVersion();
+}
+
+/*
+	Joins together the objects each constraint touches, so that every group of
+	connected objects ends up as one island. Static objects are left out, as they
+	don't move - otherwise everything hanging from the same wall would have to
+	wait for each other to settle. Islands are only worked out again when the
+	constraints change, so an object becoming static (or not) later won't split
+	(or join) them.
+*/
+void PhysicsSystem::BuildConstraintIslands(std::vector<Constraint*>::const_iterator first,
+	std::vector<Constraint*>::const_iterator last, std::unordered_map<Constraint*, int>& islandOf) {
+	std::unordered_map<GameObject*, int>	bodyIndex;
+	std::vector<int>						parent;
+	std::vector<GameObject*>				bodies;
+
+	auto find = [&](int i) {
+		while (parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+	auto dynamicBodies = [&](Constraint* c) {
+		bodies.clear();
+		c->GetBodies(bodies);
+		bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
+			[](GameObject* o) {
+				return !o->GetPhysicsObject() || o->GetPhysicsObject()->GetInverseMass() <= 0.0f;
+			}), bodies.end());
+	};
+
+	for (auto i = first; i != last; ++i) {
+		dynamicBodies(*i);
+		int root = -1;
+		for (GameObject* o : bodies) {
+			auto found = bodyIndex.find(o);
+			int index = 0;
+			if (found == bodyIndex.end()) {
+				index = (int)parent.size();
+				bodyIndex.insert({ o, index });
+				parent.emplace_back(index);
+			}
+			else {
+				index = find(found->second);
+			}
+			if (root < 0) {
+				root = index;
+			}
+			else {
+				parent[index] = root;
+			}
+		}
+	}
+
+	int islandCount = 0;
+	std::unordered_map<int, int> islandOfRoot;
+	for (auto i = first; i != last; ++i) {
+		dynamicBodies(*i);
+		if (bodies.empty()) { // nothing here moves, so it's on its own
+			islandOf[*i] = islandCount++;
+			continue;
+		}
+		int root = find(bodyIndex[bodies[0]]);
+		auto found = islandOfRoot.find(root);
+		if (found == islandOfRoot.end()) {
+			found = islandOfRoot.insert({ root, islandCount++ }).first;
+		}
+		islandOf[*i] = found->second;
+	}
+	islands.assign(islandCount, ConstraintIsland());
+	islandActive.assign(islandCount, 0);
+}
+
+void PhysicsSystem::BeginConstraints() {
+	if (gameWorld.GetConstraintVersion() != batchedConstraintVersion) {
+		BuildConstraintBatches();
+	}
+	stats.constraintBatches = constraintBatcher.GetBatchCount() + positionRows.GetBatchCount();
+	stats.constraintIslands = (int)islands.size();
+	positionRows.Gather();
+}
+
+void PhysicsSystem::EndConstraints() {
+	positionRows.Scatter();
+}
+
+void PhysicsSystem::XPBDSubsteps(float dt) {
+	float substepDt = dt / (float)substeps;
+	for (int i = 0; i < substeps; ++i) {
+		IntegrateSubstep(substepDt);
+		SolveSubstepPositions(substepDt);
+		UpdateSubstepVelocities(substepDt);
+	}
+}
+
+// IntegrateAccel and IntegrateVelocity in one, remembering where everything started
+void PhysicsSystem::IntegrateSubstep(float dt) {
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	substepStartPositions.resize(last - first);
+
+	for (auto i = first; i != last; ++i) {
+		PhysicsObject* object = (*i)->GetPhysicsObject();
+		if (object == nullptr) {
+			continue;
+		}
+		Transform& transform	= (*i)->GetTransform();
+		float inverseMass		= object->GetInverseMass();
+
+		Vector3 accel = object->GetForce() * inverseMass;
+		if (applyGravity && inverseMass > 0) {
+			accel += gravity;
+		}
+		Vector3 linearVel = object->GetLinearVelocity() + accel * dt;
+		object->SetLinearVelocity(linearVel);
+
+		Vector3 angVel = object->GetAngularVelocity();
+		Vector3 torque = object->GetTorque();
+		if (torque.LengthSquared() > 0.0f) {
+			object->UpdateInertiaTensor();
+			angVel += object->GetInertiaTensor() * torque * dt;
+			object->SetAngularVelocity(angVel);
+		}
+
+		// there are a lot of substeps, so skip writing back anything that isn't moving
+		Vector3 position = transform.GetPosition();
+		substepStartPositions[i - first] = position;
+		if (linearVel.LengthSquared() > 0.0f) {
+			transform.SetPosition(Maths::MulAdd(linearVel, dt, position));
+		}
+		if (angVel.LengthSquared() > 0.0f) {
+			transform.SetOrientation(IntegrateOrientation(transform.GetOrientation(), angVel, dt));
+		}
+	}
+}
+
+void PhysicsSystem::SolveSubstepPositions(float dt) {
+	auto solve = [&](const std::vector<Constraint*>& batch, bool parallel) {
+		if (parallel && parallelConstraints && (int)batch.size() >= minParallelBatch) {
+			workers->ParallelFor((int)batch.size(),
+				[&](int begin, int end) {
+					for (int j = begin; j < end; ++j) {
+						batch[j]->SolvePositions(dt);
+					}
+				}, minParallelBatch / 2
+			);
+		}
+		else {
+			for (Constraint* c : batch) {
+				c->SolvePositions(dt);
+			}
+		}
+	};
+	for (int i = 0; i < positionalBatcher.GetBatchCount(); ++i) {
+		solve(positionalBatcher.GetBatch(i), true);
+	}
+	solve(positionalBatcher.GetSerialBatch(), false);
+}
+
+// An object's velocity is however far it actually got this substep, once the constraints have moved it
+void PhysicsSystem::UpdateSubstepVelocities(float dt) {
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+
+	float frameLinearDamping	= 1.0f - (linearDamping * dt);
+	float frameAngularDamping	= 1.0f - (0.4f * dt);
 
 	for (auto i = first; i != last; ++i) {
-		(*i)->UpdateConstraint(dt);
+		PhysicsObject* object = (*i)->GetPhysicsObject();
+		if (object == nullptr) {
+			continue;
+		}
+		Vector3 moved = (*i)->GetTransform().GetPosition() - substepStartPositions[i - first];
+		object->SetLinearVelocity(moved * (frameLinearDamping / dt));
+		object->SetAngularVelocity(object->GetAngularVelocity() * frameAngularDamping);
 	}
-}
\ No newline at end of file
+}
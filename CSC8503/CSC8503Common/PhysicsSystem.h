@@ -1,11 +1,57 @@
 #pragma once
 #include "../CSC8503Common/GameWorld.h"
 #include "QuadTree.h"
+#include "Octree.h"
+#include "ConstraintBatcher.h"
+#include "PositionConstraintArray.h"
+#include "WorkerPool.h"
 #include "../../Common/Vector2.h"
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdint>
 
 namespace NCL {
 	namespace CSC8503 {
+		// Which spatial partition the broadphase sorts objects into
+		enum class BroadPhaseStructure {
+			QuadTree,	// flat levels - cells are full height, so stacked objects share them
+			Octree		// vertically extended levels
+		};
+
+		// Counts and timings from the most recent Update, summed over all of its fixed steps
+		struct PhysicsStats {
+			int		steps				= 0;
+			int		stepRate			= 0;	// in Hz - drops when the physics can't keep up
+			int		broadphasePairs		= 0;	// pairs handed to the narrowphase (every pair, without a broadphase)
+			int		contacts			= 0;
+			float	totalMs				= 0.0f;
+			float	aabbMs				= 0.0f;	// refreshing the objects' broadphase AABBs
+			float	broadphaseMs		= 0.0f;
+			float	narrowphaseMs		= 0.0f;	// not including resolving the contacts it finds...
+			float	resolutionMs		= 0.0f;	// ...which is timed separately
+			float	constraintMs		= 0.0f;
+			float	integrateMs			= 0.0f;
+			float	collisionListMs		= 0.0f;
+			int		constraintBatches	= 0;	// not counting the serial batch
+			int		constraintIslands	= 0;
+			int		constraintIterations	= 0;	// the most any island needed in a single step
+			int		reducedRateObjects		= 0;	// updated less often than every step, by the LOD
+			int		lodTreeBuilds			= 0;	// times the reduced rate objects' tree had to be rebuilt
+		};
+
+		/*
+			A group of objects joined together by constraints (static objects don't join
+			anything). Each island keeps iterating until its constraints have settled,
+			independently of the others.
+		*/
+		struct ConstraintIsland {
+			int		iterations	= 0;		// how many the most recent step took
+			float	residual	= 0.0f;		// the largest velocity error left in its constraints
+			bool	fixedCount	= false;	// has constraints that can't measure their error, so always runs the fixed iteration count
+		};
+
 		class PhysicsSystem	{
 		public:
 			PhysicsSystem(GameWorld& g);
@@ -32,11 +78,204 @@ namespace NCL {
 				return linearDamping;
 			}
 
-			std::set<CollisionDetection::CollisionInfo>* PotentialCollisionsFromRay(Ray& r);
+			void UseBroadPhase(bool state) {
+				useBroadPhase = state;
+			}
+			bool UsingBroadPhase() const {
+				return useBroadPhase;
+			}
+
+			const PhysicsStats& GetStats() const {
+				return stats;
+			}
+
+			// The stats of the last few updates are kept, for profiling
+			void SetStatsHistoryLength(int frames) {
+				statsHistory.assign(std::max(1, frames), PhysicsStats());
+				statsHistoryNext	= 0;
+				statsHistoryCount	= 0;
+			}
+			int GetStatsHistoryCount() const {
+				return statsHistoryCount;
+			}
+			// 0 is the most recent update, which is the same as GetStats
+			const PhysicsStats& GetHistoricStats(int updatesAgo) const {
+				int size = (int)statsHistory.size();
+				return statsHistory[(statsHistoryNext - 1 - updatesAgo + size * 2) % size];
+			}
+
+			// Solves each batch of independent constraints across the worker threads
+			void UseParallelConstraints(bool state) {
+				parallelConstraints = state;
+			}
+			bool UsingParallelConstraints() const {
+				return parallelConstraints;
+			}
+
+			// The threads the constraint solver uses, free to borrow in between updates
+			WorkerPool* GetWorkerPool() const {
+				return workers;
+			}
+
+			// How many times the constraints are solved each step, when the iterations aren't adaptive
+			void SetConstraintIterations(int count) {
+				constraintIterations = std::max(1, count);
+			}
+			int GetConstraintIterations() const {
+				return constraintIterations;
+			}
+
+			/*
+				Rather than always running the fixed number of iterations, each island
+				stops as soon as its residual falls below the tolerance - but not before
+				minIterations, and never after maxIterations.
+			*/
+			void UseAdaptiveIterations(bool state) {
+				adaptiveIterations = state;
+			}
+			bool UsingAdaptiveIterations() const {
+				return adaptiveIterations;
+			}
+			void SetSolverIterations(int minIterations, int maxIterations) {
+				minSolverIterations = std::max(1, minIterations);
+				maxSolverIterations = std::max(minSolverIterations, maxIterations);
+			}
+			void SetSolverTolerance(float tolerance) {
+				solverTolerance = tolerance;
+			}
+
+			const std::vector<ConstraintIsland>& GetConstraintIslands() const {
+				return islands;
+			}
+
+			/*
+				Extended position based dynamics - each step is split into a number of
+				substeps, and in each one the objects are moved on, any constraints that
+				can solve positions move them straight back into place (just once, softened
+				by their compliance), and the objects' velocities are then worked out from
+				how far they actually moved. Constraints that can only solve velocities, and
+				collisions, are still resolved once per step as normal.
+			*/
+			void UseXPBD(bool state) {
+				useXPBD						= state;
+				batchedConstraintVersion	= -1;
+			}
+			bool UsingXPBD() const {
+				return useXPBD;
+			}
+			void SetSubsteps(int count) {
+				substeps = std::max(1, count);
+			}
+			int GetSubsteps() const {
+				return substeps;
+			}
+
+			// Solves PositionConstraints from flat arrays, rather than one virtual call at a time
+			void UseContiguousConstraints(bool state) {
+				contiguousConstraints		= state;
+				batchedConstraintVersion	= -1;
+			}
+			bool UsingContiguousConstraints() const {
+				return contiguousConstraints;
+			}
+
+			/*
+				Level of detail - objects far from every focus point (the camera, the
+				players) only move and collide every 2nd, 4th or 8th step, moving on by
+				however many steps' worth of time has passed since they last did. Objects at
+				the same distance are spread across the steps by their world ID, so that
+				each step only does a share of them. An object touched by a full rate object
+				is promoted to full rate for a while, as are objects with forces on them or
+				in constraints. The standard integrator only - XPBD ignores the LOD.
+
+				Objects that haven't moved since the last update keep their broadphase
+				boxes, so anything turning a reduced rate object itself should UseLOD(false)
+				for a frame. With the quadtree, reduced rate objects are kept in a tree of
+				their own between steps, so the broadphase only rebuilds the tree of those
+				at full rate.
+			*/
+			void UseLOD(bool state) {
+				useLOD = state;
+			}
+			bool UsingLOD() const {
+				return useLOD;
+			}
+			// Objects further than these from every focus point run at 1/2, 1/4 and 1/8 rate
+			void SetLODDistances(float half, float quarter, float eighth) {
+				lodDistances[0] = half;
+				lodDistances[1] = quarter;
+				lodDistances[2] = eighth;
+			}
+			// Without any, everything runs at full rate
+			void SetLODFocus(const std::vector<Vector3>& points) {
+				lodFocus = points;
+			}
+
+			/*
+				Every step is the same length, whatever the frame rate, and objects are
+				updated, paired up and solved in world ID order - so two runs of the same
+				level given the same updates end up in exactly the same state, bit for
+				bit, on the same build. The worker threads only ever write to objects no
+				other thread is touching in the same batch, and residuals are gathered up
+				afterwards in a fixed order, so parallel solving doesn't change that.
+
+				After each step a hash of every object's state is recorded, so runs (or
+				machines in lockstep) can be compared, and the first step they differ
+				on found.
+			*/
+			void UseDeterministicMode(bool state) {
+				deterministic = state;
+				gameWorld.SetDeterministic(state);
+			}
+			bool UsingDeterministicMode() const {
+				return deterministic;
+			}
+			// The hash after each step the last Update took, only kept in deterministic mode
+			const std::vector<uint64_t>& GetStepHashes() const {
+				return stepHashes;
+			}
+			// FNV-1a over the world ID, position, orientation and velocities of every object
+			uint64_t HashState() const;
+
+			/*
+				Copies the position, orientation and scale, velocities, forces, inverse mass
+				and active flags of every object with physics, along with the contacts the
+				system is tracking and the LOD's schedule, into buffer as plain values, one
+				after another. The buffer is resized to fit exactly, but its capacity is kept,
+				so saving into the same one again doesn't allocate anything.
+
+				RestoreState puts it all back, marking the transforms dirty, so their
+				matrices are rebuilt by the next UpdateTransforms. The objects are saved by
+				pointer, so they must all still exist (though not necessarily still be in
+				the world) - it returns false without changing anything if the buffer isn't
+				exactly the size its header says, or the world doesn't have the same number
+				of objects it had when the buffer was saved.
+			*/
+			void SaveState(std::vector<char>& buffer) const;
+			bool RestoreState(const std::vector<char>& buffer);
+
+			void SetBroadPhaseStructure(BroadPhaseStructure s) {
+				broadPhaseStructure = s;
+			}
+			BroadPhaseStructure GetBroadPhaseStructure() const {
+				return broadPhaseStructure;
+			}
+
+			/*
+				Queries against the quadtree built by the last broadphase, which is rebuilt
+				first if anything has moved since. Levels using the octree (or no broadphase
+				at all) fall back to checking every object.
+			*/
+			bool Raycast(Ray& r, RayCollision& closestCollision, GameObject* ignoreGO = nullptr);
+			GameObject* NearestObject(const Vector3& position, std::function<bool(GameObject*)> filter);
 
 		protected:
 			void BasicCollisionDetection(float dt);
 			void BroadPhase();
+			void BuildQuadTree();
+			void RefreshQueryTree();
+			void LODBroadPhase();
+			void BuildLODTree();
 			void NarrowPhase(float dt);
 
 			void ClearForces();
@@ -44,11 +283,57 @@ namespace NCL {
 			void IntegrateAccel(float dt);
 			void IntegrateVelocity(float dt);
 
+			void BuildConstraintBatches();
+			void BeginConstraints();
+			void SolveConstraintIslands(float dt);
 			void UpdateConstraints(float dt);
+			void UpdateIslandResiduals();
+			void EndConstraints();
+
+			void XPBDSubsteps(float dt);
+			void IntegrateSubstep(float dt);
+			void SolveSubstepPositions(float dt);
+			void UpdateSubstepVelocities(float dt);
+			void SolveConstraints(const std::vector<Constraint*>& batch, const std::vector<int>& islandOf, float dt);
+			void BuildConstraintIslands(std::vector<Constraint*>::const_iterator first,
+				std::vector<Constraint*>::const_iterator last, std::unordered_map<Constraint*, int>& islandOf);
 
 			void UpdateCollisionList();
 			void UpdateObjectAABBs();
 
+			struct BodyLOD {
+				int		interval		= 1;		// steps between updates - 1, 2, 4 or 8
+				int		lastStep		= -1;		// the step it last moved on, -1 if it never has
+				int		fullRateUntil	= 0;		// promoted after touching a full rate object
+				bool	due				= true;		// moves and collides this step
+			};
+			BodyLOD& LODOf(const GameObject* o);
+			void UpdateLODLevels();
+			void ScheduleLOD();
+			int LODSteps(const GameObject* o);
+			void PromoteLOD(const GameObject* a, const GameObject* b);
+			bool SkipLODPair(const GameObject* a, const GameObject* b) {
+				return useLOD && !LODOf(a).due && !LODOf(b).due;
+			}
+
+			// Where a reduced rate object was put in lodTree, with room to move
+			struct LODTreeBox {
+				Vector3	position;
+				Vector3	halfSize;
+				bool	cached	= false;	// was reduced rate when lodTree was built
+
+				bool Contains(const Vector3& pos, const Vector3& size) const {
+					Vector3 offset = pos - position;
+					return	std::abs(offset.x) + size.x <= halfSize.x &&
+							std::abs(offset.y) + size.y <= halfSize.y &&
+							std::abs(offset.z) + size.z <= halfSize.z;
+				}
+			};
+			LODTreeBox& LODTreeBoxOf(const GameObject* o);
+			bool InLODTree(const GameObject* o) { // and not also in the per step tree
+				return LODTreeBoxOf(o).cached && LODOf(o).interval > 1;
+			}
+
 			void ImpulseResolveCollision(GameObject& a, GameObject&b, CollisionDetection::ContactPoint& p) const;
 			void ResolveSpringCollision(GameObject& a, GameObject&b, CollisionDetection::ContactPoint& p, float dt) const;
 
@@ -61,13 +346,70 @@ namespace NCL {
 			float	linearDamping = 0.4f;
 
 			std::set<CollisionDetection::CollisionInfo> allCollisions;
-			std::set<CollisionDetection::CollisionInfo> broadphaseCollisions;
+			std::vector<CollisionDetection::CollisionInfo> broadphaseCollisions; // the trees never report a pair twice
 
 			// new
 			std::set<CollisionDetection::CollisionInfo> dynamicCollisionObject;
 			std::set<CollisionDetection::CollisionInfo> staticCollisionObject;
 
 			NCL::CSC8503::QuadTree<GameObject*>* tree;
+			NCL::CSC8503::Octree<GameObject*>* octree;
+			BroadPhaseStructure broadPhaseStructure = BroadPhaseStructure::QuadTree;
+
+			std::vector<QuadTreeQueryResult<GameObject*>> queryResults; // kept between queries
+			bool queryTreeStale = false; // objects have moved since the quadtree was built
+
+			PhysicsStats stats;
+			std::vector<PhysicsStats>	statsHistory = std::vector<PhysicsStats>(120);	// a ring buffer...
+			int							statsHistoryNext	= 0;	// ...and where the next update goes in it
+			int							statsHistoryCount	= 0;
+
+			ConstraintBatcher		constraintBatcher;	// everything not in positionRows
+			PositionConstraintArray	positionRows;
+			WorkerPool*			workers;
+			int					batchedConstraintVersion	= -1;
+			bool				parallelConstraints			= true;
+			bool				contiguousConstraints		= true;
+
+			std::vector<ConstraintIsland>	islands;
+			std::vector<char>				islandActive;			// not a vector<bool>, so the solver can have a pointer to it
+			std::vector<std::vector<int>>	batchIslands;			// the island of each constraint in constraintBatcher's batches...
+			std::vector<int>				serialBatchIslands;		// ...and in its serial batch
+			int		constraintIterations	= 10;
+			bool	adaptiveIterations		= true;
+			int		minSolverIterations		= 2;
+			int		maxSolverIterations		= 20;
+			float	solverTolerance			= 0.001f;	// in m/s
+
+			bool					useXPBD		= false;
+			int						substeps	= 8;
+			ConstraintBatcher		positionalBatcher;	// the constraints XPBD solves
+			std::vector<Vector3>	substepStartPositions;
+			static const int	minParallelBatch			= 64; // smaller batches aren't worth the threads' wake up time
+
+			bool					useLOD				= false;
+			float					lodDistances[3]		= { 200.0f, 400.0f, 800.0f };
+			std::vector<Vector3>	lodFocus;
+			std::vector<BodyLOD>	bodyLOD;			// indexed by world ID
+			int						lodStep				= 0;
+			int						lodConstraintVersion	= -1;
+			std::unordered_set<const GameObject*>	constrainedBodies;	// always run at full rate
+			static const int		lodPromotionSteps	= 60;
+			int						lodAABBStep			= -1;	// the step the broadphase boxes were last refreshed at
+
+			NCL::CSC8503::QuadTree<GameObject*>*	lodTree;
+			std::vector<LODTreeBox>	lodTreeBoxes;		// indexed by world ID
+			std::vector<std::pair<GameObject*, GameObject*>>	lodTreePairs;	// overlapping boxes in lodTree
+			std::vector<std::pair<GameObject*, GameObject*>>	lodStepPairs;
+			std::vector<GameObject*>	lodQueryResults;
+			int						lodTreeStep			= 0;
+			int						lodTreeObjectVersion	= -1;
+			bool					lodTreeStale		= true;
+			static const int		lodTreeSteps		= 32;		// rebuilt at least this often, to pick up changes of rate
+			float					lodTreeSlack		= 0.1f;		// room to move beyond where an object's velocity would take it
+
+			bool					deterministic	= false;
+			std::vector<uint64_t>	stepHashes;
 
 			bool useBroadPhase		= true;
 			int numCollisionFrames	= 5;
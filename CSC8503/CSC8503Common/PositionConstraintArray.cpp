@@ -0,0 +1,157 @@
+#include "PositionConstraintArray.h"
+#include "Constraint.h"
+#include "GameObject.h"
+#include "PhysicsObject.h"
+#include <cmath>
+
+using namespace NCL::CSC8503;
+
+void PositionConstraintArray::Clear() {
+	bodyIndices.clear();
+	bodies.clear();
+	rowA.clear();
+	rowB.clear();
+	rowDistance.clear();
+	rowIsland.clear();
+	rowResidual.clear();
+	batchStarts.clear();
+	batchStarts.emplace_back(0);
+	batchParallel.clear();
+}
+
+int PositionConstraintArray::BodyIndex(GameObject* o) {
+	auto i = bodyIndices.find(o);
+	if (i != bodyIndices.end()) {
+		return i->second;
+	}
+	int index = (int)bodies.size();
+	bodyIndices.insert({ o, index });
+	bodies.emplace_back(o);
+	return index;
+}
+
+void PositionConstraintArray::AddBatch(const std::vector<Constraint*>& batch, const std::vector<int>& islands, bool parallel) {
+	if (batch.empty()) {
+		return;
+	}
+	for (size_t i = 0; i < batch.size(); ++i) {
+		const PositionConstraint* p = (const PositionConstraint*)batch[i];
+		rowA.emplace_back(BodyIndex(p->GetObjectA()));
+		rowB.emplace_back(BodyIndex(p->GetObjectB()));
+		rowDistance.emplace_back(p->GetDistance());
+		rowIsland.emplace_back(islands[i]);
+	}
+	rowInverseConstraintMass.resize(rowDistance.size());
+	rowResidual.resize(rowDistance.size());
+	batchStarts.emplace_back((int)rowDistance.size());
+	batchParallel.emplace_back(parallel);
+
+	size_t bodyCount = bodies.size();
+	positionX.resize(bodyCount);
+	positionY.resize(bodyCount);
+	positionZ.resize(bodyCount);
+	velocityX.resize(bodyCount);
+	velocityY.resize(bodyCount);
+	velocityZ.resize(bodyCount);
+	inverseMass.resize(bodyCount);
+}
+
+void PositionConstraintArray::Gather() {
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		Vector3 position		= bodies[i]->GetTransform().GetPosition();
+		PhysicsObject* physics	= bodies[i]->GetPhysicsObject();
+		Vector3 velocity		= physics->GetLinearVelocity();
+
+		positionX[i]	= position.x;
+		positionY[i]	= position.y;
+		positionZ[i]	= position.z;
+		velocityX[i]	= velocity.x;
+		velocityY[i]	= velocity.y;
+		velocityZ[i]	= velocity.z;
+		inverseMass[i]	= physics->GetInverseMass();
+	}
+	// a row's masses can't change mid-step, so there's no need to divide by them every iteration
+	for (size_t r = 0; r < rowDistance.size(); ++r) {
+		float constraintMass = inverseMass[rowA[r]] + inverseMass[rowB[r]];
+		rowInverseConstraintMass[r] = (constraintMass > 0.0f) ? 1.0f / constraintMass : 0.0f;
+	}
+}
+
+void PositionConstraintArray::Scatter() {
+	for (size_t i = 0; i < bodies.size(); ++i) {
+		bodies[i]->GetPhysicsObject()->SetLinearVelocity(Vector3(velocityX[i], velocityY[i], velocityZ[i]));
+	}
+}
+
+/*
+	The same maths as PositionConstraint::UpdateConstraint, other than multiplying
+	by the inverse of the constraint mass worked out in Gather, so results match
+	the virtual path to within rounding. Everything a row needs is read before
+	anything is written, so the compiler doesn't have to assume each write might
+	have changed the next value it reads.
+*/
+void PositionConstraintArray::SolveRows(int begin, int end, float dt, const char* activeIslands) {
+	const float bias = -(0.01f / dt);
+
+	const int*		indexA		= rowA.data();
+	const int*		indexB		= rowB.data();
+	const float*	distances	= rowDistance.data();
+	const float*	posX		= positionX.data();
+	const float*	posY		= positionY.data();
+	const float*	posZ		= positionZ.data();
+	const float*	invMass		= inverseMass.data();
+	const float*	invRowMass	= rowInverseConstraintMass.data();
+	const int*		islands		= rowIsland.data();
+	float*			residuals	= rowResidual.data();
+	float*			velX		= velocityX.data();
+	float*			velY		= velocityY.data();
+	float*			velZ		= velocityZ.data();
+
+	for (int r = begin; r < end; ++r) {
+		if (!activeIslands[islands[r]]) {
+			continue;
+		}
+		residuals[r] = 0.0f;
+
+		const int a = indexA[r];
+		const int b = indexB[r];
+
+		const float relativeX = posX[a] - posX[b];
+		const float relativeY = posY[a] - posY[b];
+		const float relativeZ = posZ[a] - posZ[b];
+
+		const float currentDistance	= std::sqrt((relativeX * relativeX) + (relativeY * relativeY) + (relativeZ * relativeZ));
+		const float offset			= distances[r] - currentDistance;
+		const float invConstraintMass	= invRowMass[r];
+
+		if (offset == 0.0f || invConstraintMass == 0.0f) {
+			continue;
+		}
+		const float invMassA = invMass[a];
+		const float invMassB = invMass[b];
+		const float invLength	= (currentDistance != 0.0f) ? 1.0f / currentDistance : 1.0f;
+		const float dirX		= relativeX * invLength;
+		const float dirY		= relativeY * invLength;
+		const float dirZ		= relativeZ * invLength;
+
+		const float velAX = velX[a], velAY = velY[a], velAZ = velZ[a];
+		const float velBX = velX[b], velBY = velY[b], velBZ = velZ[b];
+
+		const float velocityDot = ((velAX - velBX) * dirX) + ((velAY - velBY) * dirY) + ((velAZ - velBZ) * dirZ);
+		const float error		= velocityDot + (bias * offset);
+		const float lambda		= -error * invConstraintMass;
+		residuals[r] = std::abs(error);
+
+		const float impulseX = dirX * lambda;
+		const float impulseY = dirY * lambda;
+		const float impulseZ = dirZ * lambda;
+
+		velX[a] = velAX + impulseX * invMassA;
+		velY[a] = velAY + impulseY * invMassA;
+		velZ[a] = velAZ + impulseZ * invMassA;
+
+		velX[b] = velBX - impulseX * invMassB;
+		velY[b] = velBY - impulseY * invMassB;
+		velZ[b] = velBZ - impulseZ * invMassB;
+	}
+}
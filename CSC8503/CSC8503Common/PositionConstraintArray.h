@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+namespace NCL {
+	namespace CSC8503 {
+		class Constraint;
+		class GameObject;
+
+		/*
+			Every PositionConstraint in the world, flattened into rows that index into
+			a copy of their objects' positions, velocities and inverse masses. Solving a
+			row then only touches a few floats in arrays, rather than following pointers
+			from the constraint to its GameObjects, and on to their Transforms and
+			PhysicsObjects, every iteration.
+
+			Only velocities change while the constraints are solved, so the objects'
+			state is copied in once per step (Gather), and their new velocities are
+			copied back out once all of the iterations are done (Scatter). That means
+			nothing else may touch these objects in between - PhysicsSystem keeps
+			constraints sharing objects with other kinds of constraint out of here.
+
+			Rows are added a batch at a time, so that rows in the same batch never share
+			an object, and can be solved in parallel.
+		*/
+		class PositionConstraintArray	{
+		public:
+			PositionConstraintArray() {}
+			~PositionConstraintArray() {}
+
+			void Clear();
+
+			/*
+				Every constraint in the batch must be a PositionConstraint. islands holds
+				the constraint island each of them belongs to.
+			*/
+			void AddBatch(const std::vector<Constraint*>& batch, const std::vector<int>& islands, bool parallel);
+
+			void Gather();
+			void Scatter();
+
+			// Skips rows whose island isn't active, and records each solved row's residual
+			void SolveRows(int begin, int end, float dt, const char* activeIslands);
+
+			int GetRowCount() const {
+				return (int)rowDistance.size();
+			}
+			int GetBatchCount() const {
+				return (int)batchStarts.size() - 1;
+			}
+			int GetBatchStart(int batch) const {
+				return batchStarts[batch];
+			}
+			int GetBatchEnd(int batch) const {
+				return batchStarts[batch + 1];
+			}
+			int GetRowIsland(int row) const {
+				return rowIsland[row];
+			}
+			// The velocity error the row had when it was last solved
+			float GetRowResidual(int row) const {
+				return rowResidual[row];
+			}
+
+			// False if the batch's rows might share objects
+			bool IsParallelBatch(int batch) const {
+				return batchParallel[batch];
+			}
+
+		protected:
+			int BodyIndex(GameObject* o);
+
+			std::unordered_map<GameObject*, int> bodyIndices;
+			std::vector<GameObject*> bodies;
+
+			std::vector<float> positionX;
+			std::vector<float> positionY;
+			std::vector<float> positionZ;
+			std::vector<float> velocityX;
+			std::vector<float> velocityY;
+			std::vector<float> velocityZ;
+			std::vector<float> inverseMass;
+
+			std::vector<int>	rowA;
+			std::vector<int>	rowB;
+			std::vector<float>	rowDistance;
+			std::vector<float>	rowInverseConstraintMass;	// worked out again every Gather
+			std::vector<int>	rowIsland;
+			std::vector<float>	rowResidual;
+
+			std::vector<int>	batchStarts = { 0 };
+			std::vector<bool>	batchParallel;
+		};
+	}
+}
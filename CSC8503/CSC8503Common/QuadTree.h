@@ -1,9 +1,10 @@
 #pragma once
 #include "../../Common/Vector2.h"
 #include "../CSC8503Common/CollisionDetection.h"
-#include "Debug.h"
-#include <list>
+#include <vector>
 #include <functional>
+#include <algorithm>
+#include <climits>
 
 namespace NCL {
 	using namespace NCL::Maths;
@@ -17,6 +18,8 @@ namespace NCL {
 			Vector3 size;
 			T object;
 
+			QuadTreeEntry() {}
+
 			QuadTreeEntry(T obj, Vector3 pos, Vector3 size) {
 				object		= obj;
 				this->pos	= pos;
@@ -24,130 +27,494 @@ namespace NCL {
 			}
 		};
 
+		// A leaf's contents - a contiguous slice of the tree's entry array
 		template<class T>
-		class QuadTreeNode	{
-		public:
-			typedef std::function<void(std::list<QuadTreeEntry<T>>&)> QuadTreeFunc;
-		protected:
-			friend class QuadTree<T>;
+		struct QuadTreeRange {
+			QuadTreeEntry<T>* first;
+			QuadTreeEntry<T>* last;
+
+			QuadTreeRange(QuadTreeEntry<T>* first, QuadTreeEntry<T>* last) {
+				this->first = first;
+				this->last	= last;
+			}
 
-			QuadTreeNode() {}
+			QuadTreeEntry<T>* begin() const { return first; }
+			QuadTreeEntry<T>* end()	const { return last; }
+			size_t	size()	const { return last - first; }
+			bool	empty() const { return first == last; }
+		};
+
+		// An object found by a ray or nearest neighbour query, and how far away it is
+		template<class T>
+		struct QuadTreeQueryResult {
+			T		object;
+			float	distance;
+
+			QuadTreeQueryResult(T object, float distance) {
+				this->object	= object;
+				this->distance	= distance;
+			}
+
+			bool operator<(const QuadTreeQueryResult<T>& other) const {
+				return distance < other.distance;
+			}
+		};
+
+		/*
+			Nodes live in a flat pool owned by the QuadTree, and refer to each other by
+			index - a split node's four children are always stored next to each other,
+			starting at 'children'. While the tree is being built, a leaf's contents are
+			a chain of links through the tree's link pool; the first call to
+			OperateOnContents then packs every leaf's entries into one array.
+
+			An object straddling a boundary is stored in every leaf it touches, so a pair
+			can share several leaves. OperateOnPairs only reports a pair from the first
+			leaf the two objects share, so no pair is ever reported twice.
+		*/
+		struct QuadTreeNode	{
+			Vector2 position;
+			Vector2 size;
+
+			int children;	// pool index of the first child, or -1 for a leaf
+			int head;		// first link of this leaf's contents, or -1 if empty
+			int count;
+			int firstEntry;	// start of this leaf's contents in the packed entry array
 
 			QuadTreeNode(Vector2 pos, Vector2 size) {
-				children		= nullptr;
 				this->position	= pos;
 				this->size		= size;
+				children		= -1;
+				head			= -1;
+				count			= 0;
+				firstEntry		= 0;
 			}
+		};
+	}
+}
+
 
-			~QuadTreeNode() {
-				delete[] children;
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace CSC8503 {
+		/*
+			Clear() keeps hold of the memory used by the pools, so once they have grown
+			to fit the scene, the tree can be rebuilt every frame without allocating.
+		*/
+		template<class T>
+		class QuadTree
+		{
+		public:
+			typedef std::function<void(QuadTreeRange<T>&)> QuadTreeFunc;
+
+			QuadTree(Vector2 size, int maxDepth = 6, int maxSize = 5){
+				this->size		= size;
+				this->maxDepth	= maxDepth;
+				this->maxSize	= maxSize;
+				Clear();
+			}
+			~QuadTree() {
 			}
 
-			void Insert(T& object, const Vector3& objectPos, const Vector3& objectSize, int depthLeft, int maxSize) {
-				if (!CollisionDetection::AABBTest(objectPos,
-					Vector3(position.x, 0, position.y), objectSize,
-					Vector3(size.x, 1000.0f, size.y))) {
-					return;
+			void Insert(T object, const Vector3& pos, const Vector3& size) {
+				objects.push_back(QuadTreeEntry<T>(object, pos, size));
+				Insert(0, (int)objects.size() - 1, maxDepth);
+				packed = false;
+			}
+
+			void DebugDraw() {
+
+			}
+
+			template<typename Func>
+			void OperateOnContents(Func&& func) {
+				PackEntries();
+				for (const QuadTreeNode& n : nodes) {
+					if (n.children < 0 && n.count > 0) {
+						QuadTreeRange<T> range(&entries[n.firstEntry], &entries[n.firstEntry] + n.count);
+						func(range);
+					}
 				}
-				if (children) { // not a leaf node, just descend the tree
-					for (int i = 0; i < 4; ++i) {
-						children[i].Insert(object, objectPos, objectSize, depthLeft - 1, maxSize);
-					}
-				}
-				else { // currently a leaf node, can just expand
-					contents.push_back(QuadTreeEntry <T >(object, objectPos, objectSize));
-					if ((int)contents.size() > maxSize && depthLeft > 0) {
-						if (!children) {
-							Split();
-							// we need to reinsert the contents so far
-							for (const auto& i : contents) {
-								for (int j = 0; j < 4; ++j) {
-									auto entry = i;
-									children[j].Insert(entry.object, entry.pos, entry.size, depthLeft - 1, maxSize);
-								}
+			}
+
+			/*
+				Calls func once for every pair of objects sharing a leaf. Each object's
+				leaves are kept in pool order, so the first shared leaf is found by merging
+				two (usually single element) lists.
+			*/
+			template<typename Func>
+			void OperateOnPairs(Func&& func) {
+				PackEntries();
+				for (int node = 0; node < (int)nodes.size(); ++node) {
+					const QuadTreeNode& n = nodes[node];
+					if (n.children >= 0 || n.count < 2) {
+						continue;
+					}
+					int end = n.firstEntry + n.count;
+					for (int i = n.firstEntry; i < end; ++i) {
+						for (int j = i + 1; j < end; ++j) {
+							if (FirstSharedLeaf(entryObjects[i], entryObjects[j]) == node) {
+								func(entries[i], entries[j]);
 							}
-							contents.clear(); // contents now distributed
 						}
 					}
 				}
 			}
 
-			void Split() {
-				Vector2 halfSize = size / 2.0f;
-				children = new QuadTreeNode <T>[4];
-				children[0] = QuadTreeNode <T>(position + Vector2(-halfSize.x, halfSize.y), halfSize);
-				children[1] = QuadTreeNode <T>(position + Vector2(halfSize.x, halfSize.y), halfSize);
-				children[2] = QuadTreeNode <T>(position + Vector2(-halfSize.x, -halfSize.y), halfSize);
-				children[3] = QuadTreeNode <T>(position + Vector2(halfSize.x, -halfSize.y), halfSize);
+			/*
+				The queries below only visit the nodes that could hold an answer, and write
+				into the caller's buffer (clearing it first), so a buffer that is kept between
+				calls stops allocating once it is big enough. An object stored in several
+				leaves is still only reported once.
+			*/
+
+			// Every object whose box overlaps the given box
+			void RangeQuery(const Vector3& pos, const Vector3& halfSize, std::vector<T>& results) {
+				results.clear();
+				BeginQuery();
+				RangeQuery(0, pos, halfSize, results);
 			}
 
-			void Clear() {
-				//delete children;
+			/*
+				Every object whose box is hit by the ray, within maxDistance, sorted front
+				to back by the distance at which the ray enters its box. Nodes are also
+				visited front to back, so anything past maxDistance is never looked at.
+			*/
+			void RayQuery(const Ray& r, std::vector<QuadTreeQueryResult<T>>& results, float maxDistance = FLT_MAX) {
+				results.clear();
+				BeginQuery();
+				RayQuery(0, r, maxDistance, results);
+				std::sort(results.begin(), results.end());
 			}
 
-			void DebugDraw() {
+			/*
+				The k objects with centres closest to pos, nearest first. The results buffer
+				doubles as a bounded max-heap while searching, so once it holds k objects,
+				any node further away than the worst of them is skipped.
+			*/
+			template<typename Filter>
+			void NearestNeighbours(const Vector3& pos, int k, std::vector<QuadTreeQueryResult<T>>& results, Filter&& filter) {
+				results.clear();
+				if (k <= 0) {
+					return;
+				}
+				BeginQuery();
+				NearestNeighbours(0, pos, k, results, filter);
+				std::sort_heap(results.begin(), results.end());
+				for (auto& i : results) {
+					i.distance = sqrt(i.distance);
+				}
+			}
 
+			void NearestNeighbours(const Vector3& pos, int k, std::vector<QuadTreeQueryResult<T>>& results) {
+				NearestNeighbours(pos, k, results, [](const T&) { return true; });
 			}
 
-			void OperateOnContents(QuadTreeFunc& func) {
-				if (children) {
+			void Clear() {
+				nodes.clear();
+				objects.clear();
+				links.clear();
+				entries.clear();
+				entryObjects.clear();
+				nodes.push_back(QuadTreeNode(Vector2(), size));
+				packed = true;
+			}
+
+		protected:
+			struct Link {
+				int object;
+				int next;
+			};
+
+			// nodes can move as the pool grows, so this works by index throughout
+			void Insert(int node, int object, int depthLeft) {
+				const QuadTreeEntry<T>& o = objects[object];
+				if (!CollisionDetection::AABBTest(o.pos,
+					Vector3(nodes[node].position.x, 0, nodes[node].position.y), o.size,
+					Vector3(nodes[node].size.x, 1000.0f, nodes[node].size.y))) {
+					return;
+				}
+				if (nodes[node].children >= 0) { // not a leaf node, just descend the tree
+					int first = nodes[node].children;
 					for (int i = 0; i < 4; ++i) {
-						children[i].OperateOnContents(func);
+						Insert(first + i, object, depthLeft - 1);
 					}
+					return;
 				}
-				else {
-					if (!contents.empty()) {
-						func(contents);
+				// currently a leaf node, can just expand
+				links.push_back({ object, nodes[node].head });
+				nodes[node].head = (int)links.size() - 1;
+				nodes[node].count++;
+
+				if (nodes[node].count > maxSize && depthLeft > 0) {
+					Split(node);
+					// we need to reinsert the contents so far
+					int link = nodes[node].head;
+					nodes[node].head	= -1;
+					nodes[node].count	= 0;
+					int first = nodes[node].children;
+					while (link >= 0) {
+						for (int j = 0; j < 4; ++j) {
+							Insert(first + j, links[link].object, depthLeft - 1);
+						}
+						link = links[link].next;
 					}
 				}
 			}
 
-		protected:
-			std::list<QuadTreeEntry<T>> contents;
+			void Split(int node) {
+				Vector2 position = nodes[node].position;
+				Vector2 halfSize = nodes[node].size / 2.0f;
+				nodes[node].children = (int)nodes.size();
+				nodes.push_back(QuadTreeNode(position + Vector2(-halfSize.x, halfSize.y), halfSize));
+				nodes.push_back(QuadTreeNode(position + Vector2(halfSize.x, halfSize.y), halfSize));
+				nodes.push_back(QuadTreeNode(position + Vector2(-halfSize.x, -halfSize.y), halfSize));
+				nodes.push_back(QuadTreeNode(position + Vector2(halfSize.x, -halfSize.y), halfSize));
+			}
 
-			Vector2 position;
-			Vector2 size;
+			// Stamps each object the first time a query sees it, so nothing is reported twice
+			void BeginQuery() {
+				PackEntries();
+				if (queryStamps.size() < objects.size()) {
+					queryStamps.resize(objects.size(), 0);
+				}
+				if (++queryCount == INT_MAX) {
+					std::fill(queryStamps.begin(), queryStamps.end(), 0);
+					queryCount = 1;
+				}
+			}
 
-			QuadTreeNode<T>* children;
-		};
-	}
-}
+			bool FirstVisit(int entry) {
+				int& stamp = queryStamps[entryObjects[entry]];
+				if (stamp == queryCount) {
+					return false;
+				}
+				stamp = queryCount;
+				return true;
+			}
 
+			bool NodeOverlaps(const QuadTreeNode& n, const Vector3& pos, const Vector3& halfSize) const {
+				return CollisionDetection::AABBTest(pos,
+					Vector3(n.position.x, 0, n.position.y), halfSize,
+					Vector3(n.size.x, 1000.0f, n.size.y));
+			}
 
-namespace NCL {
-	using namespace NCL::Maths;
-	namespace CSC8503 {
-		template<class T>
-		class QuadTree
-		{
-		public:
-			QuadTree(Vector2 size, int maxDepth = 6, int maxSize = 5){
-				root = QuadTreeNode<T>(Vector2(), size);
-				this->maxDepth	= maxDepth;
-				this->maxSize	= maxSize;
+			void RangeQuery(int node, const Vector3& pos, const Vector3& halfSize, std::vector<T>& results) {
+				const QuadTreeNode& n = nodes[node];
+				if (!NodeOverlaps(n, pos, halfSize)) {
+					return;
+				}
+				if (n.children >= 0) {
+					for (int i = 0; i < 4; ++i) {
+						RangeQuery(n.children + i, pos, halfSize, results);
+					}
+					return;
+				}
+				for (int i = n.firstEntry; i < n.firstEntry + n.count; ++i) {
+					if (CollisionDetection::AABBTest(pos, entries[i].pos, halfSize, entries[i].size) && FirstVisit(i)) {
+						results.push_back(entries[i].object);
+					}
+				}
 			}
-			~QuadTree() {
+
+			/*
+				Slab test of a ray against a box. Nodes have no height, so they only test
+				the x and z slabs. Returns the distance the ray enters the box at, which is
+				0 if it starts inside it.
+			*/
+			static bool RaySlabs(const Ray& r, const Vector3& boxMin, const Vector3& boxMax, bool testY, float& tNear) {
+				Vector3 origin	= r.GetPosition();
+				Vector3 dir		= r.GetDirection();
+				float tMin = 0.0f;
+				float tMax = FLT_MAX;
+				for (int axis = 0; axis < 3; ++axis) {
+					if (axis == 1 && !testY) {
+						continue;
+					}
+					if (std::abs(dir[axis]) < 1e-8f) { // parallel to this slab, so it has to start inside it
+						if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis]) {
+							return false;
+						}
+						continue;
+					}
+					float inv	= 1.0f / dir[axis];
+					float t0	= (boxMin[axis] - origin[axis]) * inv;
+					float t1	= (boxMax[axis] - origin[axis]) * inv;
+					if (t0 > t1) {
+						std::swap(t0, t1);
+					}
+					tMin = std::max(tMin, t0);
+					tMax = std::min(tMax, t1);
+					if (tMin > tMax) {
+						return false;
+					}
+				}
+				tNear = tMin;
+				return true;
 			}
 
-			void Insert(T object, const Vector3& pos, const Vector3& size) {
-				root.Insert(object, pos, size, maxDepth, maxSize);
+			bool RayHitsNode(const QuadTreeNode& n, const Ray& r, float& tNear) const {
+				Vector3 nodeMin(n.position.x - n.size.x, 0, n.position.y - n.size.y);
+				Vector3 nodeMax(n.position.x + n.size.x, 0, n.position.y + n.size.y);
+				return RaySlabs(r, nodeMin, nodeMax, false, tNear);
 			}
 
-			void DebugDraw() {
-				root.DebugDraw();
+			void RayQuery(int node, const Ray& r, float maxDistance, std::vector<QuadTreeQueryResult<T>>& results) {
+				const QuadTreeNode& n = nodes[node];
+				if (n.children >= 0) {
+					// visit whichever children the ray passes through, in the order it enters them
+					int		order[4];
+					float	distances[4];
+					int		hitCount = 0;
+					for (int i = 0; i < 4; ++i) {
+						float tNear;
+						if (!RayHitsNode(nodes[n.children + i], r, tNear) || tNear > maxDistance) {
+							continue;
+						}
+						int j = hitCount++;
+						for (; j > 0 && distances[j - 1] > tNear; --j) {
+							order[j]		= order[j - 1];
+							distances[j]	= distances[j - 1];
+						}
+						order[j]		= n.children + i;
+						distances[j]	= tNear;
+					}
+					for (int i = 0; i < hitCount; ++i) {
+						RayQuery(order[i], r, maxDistance, results);
+					}
+					return;
+				}
+				for (int i = n.firstEntry; i < n.firstEntry + n.count; ++i) {
+					float tNear;
+					if (RaySlabs(r, entries[i].pos - entries[i].size, entries[i].pos + entries[i].size, true, tNear)
+						&& tNear <= maxDistance && FirstVisit(i)) {
+						results.push_back(QuadTreeQueryResult<T>(entries[i].object, tNear));
+					}
+				}
 			}
 
-			void OperateOnContents(typename QuadTreeNode<T>::QuadTreeFunc  func) {
-				root.OperateOnContents(func);
+			// Squared distance from pos to the closest point of the node - 0 if it's inside
+			static float NodeDistanceSquared(const QuadTreeNode& n, const Vector3& pos) {
+				float dx = std::max(std::abs(pos.x - n.position.x) - n.size.x, 0.0f);
+				float dz = std::max(std::abs(pos.z - n.position.y) - n.size.y, 0.0f);
+				return dx * dx + dz * dz;
 			}
 
-			void Clear() {
-				root.Clear();
+			// While searching, results holds squared distances
+			template<typename Filter>
+			void NearestNeighbours(int node, const Vector3& pos, int k, std::vector<QuadTreeQueryResult<T>>& results, Filter& filter) {
+				const QuadTreeNode& n = nodes[node];
+				if ((int)results.size() == k && NodeDistanceSquared(n, pos) >= results.front().distance) {
+					return;
+				}
+				if (n.children >= 0) {
+					// nearest child first, so the worst distance shrinks as soon as possible
+					int		order[4];
+					float	distances[4];
+					for (int i = 0; i < 4; ++i) {
+						float d = NodeDistanceSquared(nodes[n.children + i], pos);
+						int j = i;
+						for (; j > 0 && distances[j - 1] > d; --j) {
+							order[j]		= order[j - 1];
+							distances[j]	= distances[j - 1];
+						}
+						order[j]		= n.children + i;
+						distances[j]	= d;
+					}
+					for (int i = 0; i < 4; ++i) {
+						NearestNeighbours(order[i], pos, k, results, filter);
+					}
+					return;
+				}
+				for (int i = n.firstEntry; i < n.firstEntry + n.count; ++i) {
+					if (!FirstVisit(i) || !filter(entries[i].object)) {
+						continue;
+					}
+					float distance = (entries[i].pos - pos).LengthSquared();
+					if ((int)results.size() < k) {
+						results.push_back(QuadTreeQueryResult<T>(entries[i].object, distance));
+						std::push_heap(results.begin(), results.end());
+					}
+					else if (distance < results.front().distance) {
+						std::pop_heap(results.begin(), results.end());
+						results.back() = QuadTreeQueryResult<T>(entries[i].object, distance);
+						std::push_heap(results.begin(), results.end());
+					}
+				}
 			}
-		protected:
-			QuadTreeNode<T> root;
-			int maxDepth;
-			int maxSize;
+
+			int FirstSharedLeaf(int a, int b) const {
+				const int* i	= objectLeaves.data() + leafStart[a];
+				const int* iEnd = objectLeaves.data() + leafStart[a + 1];
+				const int* j	= objectLeaves.data() + leafStart[b];
+				const int* jEnd = objectLeaves.data() + leafStart[b + 1];
+				while (i != iEnd && j != jEnd) {
+					if (*i == *j) {
+						return *i;
+					}
+					(*i < *j) ? ++i : ++j;
+				}
+				return -1;
+			}
+
+			/*
+				Copies each leaf's chain of links into its own run of the entry array, in
+				insertion order, then builds the list of leaves each object is stored in
+			*/
+			void PackEntries() {
+				if (packed) {
+					return;
+				}
+				entries.clear();
+				entryObjects.clear();
+				leafStart.assign(objects.size() + 1, 0);
+				for (QuadTreeNode& n : nodes) {
+					if (n.children >= 0 || n.count == 0) {
+						continue;
+					}
+					n.firstEntry = (int)entries.size();
+					entries.resize(entries.size() + n.count);
+					entryObjects.resize(entries.size());
+					int index = n.firstEntry + n.count;
+					for (int link = n.head; link >= 0; link = links[link].next) {
+						int object = links[link].object;
+						--index; // links were prepended
+						entries[index]		= objects[object];
+						entryObjects[index] = object;
+						leafStart[object + 1]++;
+					}
+				}
+				for (size_t i = 1; i < leafStart.size(); ++i) {
+					leafStart[i] += leafStart[i - 1];
+				}
+				leafCursor.assign(leafStart.begin(), leafStart.end() - 1);
+				objectLeaves.resize(leafStart.back());
+				for (int node = 0; node < (int)nodes.size(); ++node) {
+					const QuadTreeNode& n = nodes[node];
+					if (n.children >= 0) {
+						continue;
+					}
+					for (int i = n.firstEntry; i < n.firstEntry + n.count; ++i) {
+						objectLeaves[leafCursor[entryObjects[i]]++] = node;
+					}
+				}
+				packed = true;
+			}
+
+			std::vector<QuadTreeNode>		nodes;
+			std::vector<QuadTreeEntry<T>>	objects;	// everything inserted since the last Clear
+			std::vector<Link>				links;
+			std::vector<QuadTreeEntry<T>>	entries;
+			std::vector<int>				entryObjects;	// which object each packed entry came from
+			std::vector<int>				leafStart;		// each object's run in objectLeaves
+			std::vector<int>				leafCursor;
+			std::vector<int>				objectLeaves;
+			std::vector<int>				queryStamps;	// per object, the last query that reported it
+			int								queryCount = 0;
+
+			Vector2	size;
+			int		maxDepth;
+			int		maxSize;
+			bool	packed;
 		};
 	}
-}
\ No newline at end of file
+}
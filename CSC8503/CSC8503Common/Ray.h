@@ -1,6 +1,7 @@
 #pragma once
 #include "../../Common/Vector3.h"
 #include "../../Common/Plane.h"
+#include "../../Common/SIMD.h"
 
 namespace NCL {
 	namespace Maths {
@@ -31,5 +32,31 @@ namespace NCL {
 			Vector3 position;	//World space position
 			Vector3 direction;	//Normalised world space direction
 		};
+
+		/*
+			Four rays, stored one component at a time, so that a SIMD register can
+			hold the same component of every ray and they can all be tested against
+			a volume at once.
+		*/
+		struct RayPacket {
+			SIMD::Float4 originX;
+			SIMD::Float4 originY;
+			SIMD::Float4 originZ;
+			SIMD::Float4 directionX;
+			SIMD::Float4 directionY;
+			SIMD::Float4 directionZ;
+
+			RayPacket() {}
+			RayPacket(const Ray& a, const Ray& b, const Ray& c, const Ray& d) {
+				Vector3 o[4] = { a.GetPosition(), b.GetPosition(), c.GetPosition(), d.GetPosition() };
+				Vector3 v[4] = { a.GetDirection(), b.GetDirection(), c.GetDirection(), d.GetDirection() };
+				originX		= SIMD::Set(o[0].x, o[1].x, o[2].x, o[3].x);
+				originY		= SIMD::Set(o[0].y, o[1].y, o[2].y, o[3].y);
+				originZ		= SIMD::Set(o[0].z, o[1].z, o[2].z, o[3].z);
+				directionX	= SIMD::Set(v[0].x, v[1].x, v[2].x, v[3].x);
+				directionY	= SIMD::Set(v[0].y, v[1].y, v[2].y, v[3].y);
+				directionZ	= SIMD::Set(v[0].z, v[1].z, v[2].z, v[3].z);
+			}
+		};
 	}
 }
\ No newline at end of file
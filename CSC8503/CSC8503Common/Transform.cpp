@@ -1,38 +1,111 @@
 #include "Transform.h"
 
+#include <algorithm>
+
 using namespace NCL::CSC8503;
 
 Transform::Transform()
 {
-	scale	= Vector3(1, 1, 1);
+	scale		= Vector3(1, 1, 1);
+	matrixDirty	= false; // an identity matrix already
+	parent		= nullptr;
+	depth		= 0;
+}
+
+Transform::Transform(const Transform& t)
+{
+	orientation	= t.orientation;
+	position	= t.position;
+	scale		= t.scale;
+	matrixDirty	= true;
+	parent		= nullptr;
+	depth		= 0;
+}
+
+Transform& Transform::operator=(const Transform& t) {
+	orientation	= t.orientation;
+	position	= t.position;
+	scale		= t.scale;
+	MarkDirty();
+	return *this;
 }
 
 Transform::~Transform()
 {
+	SetParent(nullptr);
+	for (Transform* c : children) { // they keep their local values, which become world ones
+		c->parent = nullptr;
+		c->SetDepth(0);
+		c->MarkDirty();
+	}
+}
+
+// Translation * Rotation * Scale, built straight into place rather than multiplied out
+void Transform::UpdateMatrix() const {
+	matrix = Matrix4(orientation);
+	for (int i = 0; i < 3; ++i) {
+		matrix.array[i]		*= scale.x;
+		matrix.array[i + 4]	*= scale.y;
+		matrix.array[i + 8]	*= scale.z;
+	}
+	matrix.SetPositionVector(position);
+	if (parent) {
+		matrix = parent->GetMatrix() * matrix;
+	}
+	matrixDirty = false;
+}
 
+/*
+	A transform is only ever clean if its parent is too, so there's no need to
+	carry on down past one that's already dirty - and a subtree that never
+	moves is never visited at all.
+*/
+void Transform::MarkDirty() {
+	if (matrixDirty) {
+		return;
+	}
+	matrixDirty = true;
+	for (Transform* c : children) {
+		c->MarkDirty();
+	}
 }
 
-void Transform::UpdateMatrix() {
-	matrix =
-		Matrix4::Translation(position) *
-		Matrix4(orientation) *
-		Matrix4::Scale(scale);
+void Transform::SetDepth(int newDepth) {
+	depth = newDepth;
+	for (Transform* c : children) {
+		c->SetDepth(newDepth + 1);
+	}
+}
+
+void Transform::SetParent(Transform* newParent) {
+	if (newParent == parent) {
+		return;
+	}
+	if (parent) {
+		parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), this), parent->children.end());
+	}
+	parent = newParent;
+	if (parent) {
+		parent->children.emplace_back(this);
+	}
+	SetDepth(parent ? parent->depth + 1 : 0);
+	MarkDirty();
 }
 
 Transform& Transform::SetPosition(const Vector3& worldPos) {
-	position = worldPos;
-	UpdateMatrix();
+	position	= worldPos;
+	MarkDirty();
 	return *this;
 }
 
 Transform& Transform::SetScale(const Vector3& worldScale) {
-	scale = worldScale;
-	UpdateMatrix();
+	scale		= worldScale;
+	MarkDirty();
 	return *this;
 }
 
 Transform& Transform::SetOrientation(const Quaternion& worldOrientation) {
-	orientation = worldOrientation;
-	UpdateMatrix();
+	orientation	= worldOrientation;
+	MarkDirty();
 	return *this;
-}
\ No newline at end of file
+}
@@ -18,6 +18,10 @@ namespace NCL {
 			Transform();
 			~Transform();
 
+			// Copies only the position, orientation and scale - the copy has no parent or children
+			Transform(const Transform& t);
+			Transform& operator=(const Transform& t);
+
 			Transform& SetPosition(const Vector3& worldPos);
 			Transform& SetScale(const Vector3& worldScale);
 			Transform& SetOrientation(const Quaternion& newOr);
@@ -35,17 +39,71 @@ namespace NCL {
 				return orientation;
 			}
 
-			Matrix4 GetMatrix() const {
+			/*
+				The physics moves objects many times for every time anything looks at
+				their matrices, so setting the position, orientation or scale only marks
+				the matrix as out of date, and it's rebuilt here the next time it's needed.
+				For a child this is its world matrix - its parent's, times its own.
+			*/
+			const Matrix4& GetMatrix() const {
+				if (matrixDirty) {
+					UpdateMatrix();
+				}
 				return matrix;
 			}
 			
 			Vector3 GetForwardFacing() const {
-				return orientation * Vector3(0, 0, 1);
+				return GetWorldOrientation() * Vector3(0, 0, 1);
+			}
+
+			// Rebuilds the matrix now, rather than waiting for GetMatrix to
+			void UpdateMatrix() const;
+
+			bool IsMatrixDirty() const {
+				return matrixDirty;
+			}
+
+			/*
+				Attaches this transform to another, after which its position, orientation
+				and scale are all relative to that parent, and it moves whenever the
+				parent does. The physics and collision detection only ever work with the
+				values that were set, though, so a child should be something carried along
+				by a body (with no physics object of its own) rather than a body itself.
+				Pass nullptr to detach it again.
+			*/
+			void SetParent(Transform* newParent);
+
+			Transform* GetParent() const {
+				return parent;
+			}
+
+			const vector<Transform*>& GetChildren() const {
+				return children;
 			}
 
-			void UpdateMatrix();
+			// How many parents up it is to the root of its hierarchy - 0 for a root
+			int GetDepth() const {
+				return depth;
+			}
+
+			Vector3 GetWorldPosition() const {
+				return parent ? GetMatrix().GetPositionVector() : position;
+			}
+
+			Quaternion GetWorldOrientation() const {
+				return parent ? parent->GetWorldOrientation() * orientation : orientation;
+			}
 		protected:
-			Matrix4		matrix;
+			void MarkDirty();
+			void SetDepth(int newDepth);
+
+			mutable Matrix4	matrix;
+			mutable bool	matrixDirty; // if set, so is every child's
+
+			Transform*			parent;
+			vector<Transform*>	children;
+			int					depth;
+
 			Quaternion	orientation;
 			Vector3		position;
 
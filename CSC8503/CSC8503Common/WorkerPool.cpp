@@ -0,0 +1,93 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+using namespace NCL::CSC8503;
+
+WorkerPool::WorkerPool(int threadCount) {
+	job			= nullptr;
+	jobCount	= 0;
+	chunkSize	= 0;
+	chunkCount	= 0;
+	nextChunk	= 0;
+	busyWorkers	= 0;
+	generation	= 0;
+	quit		= false;
+
+	if (threadCount < 0) {
+		threadCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+	}
+	for (int i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& t : threads) {
+		t.join();
+	}
+}
+
+void WorkerPool::ParallelFor(int count, const RangeFunc& func, int minPerChunk) {
+	if (count <= 0) {
+		return;
+	}
+	int chunks = std::min(GetThreadCount(), (count + minPerChunk - 1) / std::max(1, minPerChunk));
+	if (chunks <= 1) { // not worth waking anyone up for
+		func(0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job			= &func;
+		jobCount	= count;
+		chunkCount	= chunks;
+		chunkSize	= (count + chunks - 1) / chunks;
+		nextChunk	= 0;
+		busyWorkers	= (int)threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	RunChunks();
+
+	// func lives on our stack, so every worker must be done with it before we return
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return busyWorkers == 0; });
+	job = nullptr;
+}
+
+void WorkerPool::WorkerLoop() {
+	unsigned int seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seenGeneration; });
+			if (quit) {
+				return;
+			}
+			seenGeneration = generation;
+		}
+		RunChunks();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busyWorkers == 0) {
+				done.notify_one();
+			}
+		}
+	}
+}
+
+void WorkerPool::RunChunks() {
+	for (int chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+		int begin	= chunk * chunkSize;
+		int end		= std::min(begin + chunkSize, jobCount);
+		if (begin < end) {
+			(*job)(begin, end);
+		}
+	}
+}
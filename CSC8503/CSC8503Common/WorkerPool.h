@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace NCL {
+	namespace CSC8503 {
+		/*
+			A fixed set of threads that sleep until handed a loop to split up. The
+			calling thread always takes a share of the work too, so a pool made with
+			0 threads just runs everything on the caller.
+		*/
+		class WorkerPool	{
+		public:
+			typedef std::function<void(int begin, int end)> RangeFunc;
+
+			// -1 uses one thread per spare hardware thread
+			WorkerPool(int threadCount = -1);
+			~WorkerPool();
+
+			// How many threads work on each ParallelFor, including the caller
+			int GetThreadCount() const {
+				return (int)threads.size() + 1;
+			}
+
+			/*
+				Calls func over [0, count) in contiguous chunks of at least minPerChunk,
+				and doesn't return until every chunk is done.
+			*/
+			void ParallelFor(int count, const RangeFunc& func, int minPerChunk = 1);
+
+		protected:
+			void WorkerLoop();
+			void RunChunks();
+
+			std::vector<std::thread> threads;
+
+			std::mutex				mutex;
+			std::condition_variable	wake;
+			std::condition_variable	done;
+
+			const RangeFunc*	job;
+			int					jobCount;
+			int					chunkSize;
+			int					chunkCount;
+			std::atomic<int>	nextChunk;
+			int					busyWorkers;
+			unsigned int		generation;
+			bool				quit;
+		};
+	}
+}
@@ -6,6 +6,7 @@
 #include "../../Common/TextureLoader.h"
 #include "../CSC8503Common/Constraint.h"
 #include "../CSC8503Common/NavigationGrid.h"
+#include "../CSC8503Common/Debug.h"
 #include <sstream>
 #include <iostream>
 #include <iomanip>
@@ -23,6 +24,7 @@ CourseworkGame::CourseworkGame(Window* w) {
 
 	Debug::SetRenderer(renderer);
 	physics->UseGravity(true);
+	physics->UseLOD(true);
 	Window::GetWindow()->ShowOSPointer(true);
 	Window::GetWindow()->LockMouseToWindow(true);
 
@@ -105,15 +107,26 @@ void CourseworkGame::UpdateGame(float dt) {
 	UpdateKeys();
 
 	SelectObject();
+
+	physicsFocus.clear();
+	physicsFocus.emplace_back(world->GetMainCamera()->GetPosition());
+	if (playerSphere != nullptr) {
+		physicsFocus.emplace_back(playerSphere->GetTransform().GetPosition());
+	}
+	physics->SetLODFocus(physicsFocus);
 	physics->Update(dt);
 
+	for (BalancingPlaneConstraint* b : balancingPlanes) {
+		b->SetPushOrientation(Vector3());
+	}
+
 	if (lockedObject != nullptr) {
 		Vector3 objPos = lockedObject->GetTransform().GetPosition();
 		Vector3 camPos = objPos + lockedOffset;
 
 		Matrix4 temp = Matrix4::BuildViewMatrix(camPos, objPos, Vector3(0.0f, 1.0f, 0.0f));
 
-		Matrix4 modelMat = temp.Inverse();
+		Matrix4 modelMat = temp.AffineInverse();
 
 		Quaternion q(modelMat);
 		Vector3 angles = q.ToEuler();
@@ -134,7 +147,12 @@ void CourseworkGame::UpdateGame(float dt) {
 		L2Gameplay(dt);
 	}
 
+	if (showPhysicsProfile) {
+		DrawPhysicsProfile();
+	}
+
 	Debug::FlushRenderables(dt);
+	world->UpdateTransforms(physics->GetWorkerPool()); // everything's done moving for this frame
 	renderer->Render();
 
 	// Display main menu
@@ -146,6 +164,50 @@ void CourseworkGame::UpdateGame(float dt) {
 	}
 }
 
+/*
+	The mean and worst time each physics phase took over the updates the physics
+	system has kept, along with what it was working on in the latest one.
+*/
+void CourseworkGame::DrawPhysicsProfile() {
+	int count = physics->GetStatsHistoryCount();
+	if (count == 0) {
+		return;
+	}
+	struct Phase {
+		const char*			name;
+		float PhysicsStats::*	ms;
+	};
+	const Phase phases[] = {
+		{ "Physics",		&PhysicsStats::totalMs },
+		{ "AABBs",			&PhysicsStats::aabbMs },
+		{ "Broadphase",		&PhysicsStats::broadphaseMs },
+		{ "Narrowphase",	&PhysicsStats::narrowphaseMs },
+		{ "Resolution",		&PhysicsStats::resolutionMs },
+		{ "Constraints",	&PhysicsStats::constraintMs },
+		{ "Integration",	&PhysicsStats::integrateMs },
+		{ "Collision list",	&PhysicsStats::collisionListMs }
+	};
+	float y = 20.0f;
+	for (const Phase& phase : phases) {
+		float mean	= 0.0f;
+		float worst	= 0.0f;
+		for (int i = 0; i < count; ++i) {
+			float ms = physics->GetHistoricStats(i).*phase.ms;
+			mean	+= ms;
+			worst	= std::max(worst, ms);
+		}
+		std::stringstream text;
+		text << std::fixed << std::setprecision(2) << phase.name << ": " << (mean / count) << "ms (max " << worst << ")";
+		Debug::Print(text.str(), Vector2(65.0f, y));
+		y += 3.0f;
+	}
+	const PhysicsStats& latest = physics->GetStats();
+	Debug::Print(std::to_string(latest.steps) + " steps at " + std::to_string(latest.stepRate) + "Hz", Vector2(65.0f, y));
+	Debug::Print(std::to_string(latest.broadphasePairs) + " pairs, " + std::to_string(latest.contacts) + " contacts", Vector2(65.0f, y + 3.0f));
+	Debug::Print(std::to_string(latest.constraintIslands) + " islands, up to " + std::to_string(latest.constraintIterations) + " iterations", Vector2(65.0f, y + 6.0f));
+	Debug::Print(std::to_string(latest.reducedRateObjects) + " objects at a reduced rate", Vector2(65.0f, y + 9.0f));
+}
+
 void CourseworkGame::SetGameState(int value) {
 	if (value == 1) { // Play level 1
 		LoadLevel1();
@@ -175,6 +237,46 @@ void CourseworkGame::UpdateKeys() {
 		world->ShuffleObjects(false);
 	}
 
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F1)) {
+		showPhysicsProfile = !showPhysicsProfile;
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::B)) {
+		physics->UseBroadPhase(!physics->UsingBroadPhase());
+		std::cout << "Setting broadphase to " << physics->UsingBroadPhase() << std::endl;
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::I)) {
+		physics->SetConstraintIterations(physics->GetConstraintIterations() - 1);
+		std::cout << "Setting constraint iterations to " << physics->GetConstraintIterations() << std::endl;
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::O)) {
+		physics->SetConstraintIterations(physics->GetConstraintIterations() + 1);
+		std::cout << "Setting constraint iterations to " << physics->GetConstraintIterations() << std::endl;
+	}
+
+	// P Key to push pistons
+	if (Window::GetKeyboard()->KeyDown(KeyboardKeys::P)) {
+		for (PistonConstraint* p : pistons) {
+			p->Push();
+		}
+	}
+	// The arrow keys tilt the balancing planes, for every step and iteration of this frame's update
+	for (BalancingPlaneConstraint* b : balancingPlanes) {
+		Vector3 push;
+		if (Window::GetKeyboard()->KeyDown(KeyboardKeys::UP)) {
+			push.x = 3.0f;
+		}
+		if (Window::GetKeyboard()->KeyDown(KeyboardKeys::DOWN)) {
+			push.x = -3.0f;
+		}
+		if (Window::GetKeyboard()->KeyDown(KeyboardKeys::LEFT)) {
+			push.z = -3.0f;
+		}
+		if (Window::GetKeyboard()->KeyDown(KeyboardKeys::RIGHT)) {
+			push.z = 3.0f;
+		}
+		b->SetPushOrientation(push);
+	}
+
 	if (lockedObject) {
 		LockedObjectMovement();
 	}
@@ -182,7 +284,7 @@ void CourseworkGame::UpdateKeys() {
 
 void CourseworkGame::LockedObjectMovement() {
 	Matrix4 view		= world->GetMainCamera()->BuildViewMatrix();
-	Matrix4 camWorld	= view.Inverse();
+	Matrix4 camWorld	= view.AffineInverse();
 
 	Vector3 rightAxis = Vector3(camWorld.GetColumn(0)); //view is inverse of model!
 
@@ -229,12 +331,13 @@ void CourseworkGame::InitCamera() {
 void CourseworkGame::LoadLevel1() {
 	world->ClearAndErase();
 	physics->Clear();
-	pistonPlatforms.clear();
+	pistons.clear();
+	balancingPlanes.clear();
+	coins.clear();
 	currentLevel = 1;
+	physics->SetBroadPhaseStructure(BroadPhaseStructure::Octree); // platforms are stacked vertically
 	gameTime = std::chrono::system_clock::now();
-	world->GetMainCamera()->SetPosition(Vector3(-117.6f, 16.6f, -31.8f));
-	world->GetMainCamera()->SetPitch(-10.3f);
-	world->GetMainCamera()->SetYaw(238.0f);
+	InitLevelCamera();
 
 	// Gameplay ball
 	playerSphere = AddSphereToWorld(Vector3(0.0f, 0.0f, 00.0f), 4, 2);
@@ -259,6 +362,48 @@ void CourseworkGame::LoadLevel1() {
 	AddAABBFloorToWorld(Vector3(-180.0f, -265.0f, 610.0f), Vector3(30.0f, 2.0f, 30.0f), Vector4(1.0f,1.0f,0.0f,1.0f), true);
 
 	InitialiseWreckingBall();
+	physics->SaveState(levelStart);
+}
+
+/*
+	Puts every object back where it was when the level was loaded, which is much
+	quicker than throwing the whole level away and building it again. Constraints
+	keep their own state, so pistons carry on from wherever they were.
+*/
+void CourseworkGame::RestartLevel() {
+	if (currentLevel == 1) {
+		gameTime = std::chrono::system_clock::now();
+	}
+	else if (currentLevel == 2) {
+		for (GameObject* coin : levelCoins) {
+			if (std::find(coins.begin(), coins.end(), coin) == coins.end()) {
+				world->AddGameObject(coin); // collected coins were only taken out of the world
+			}
+		}
+		coins = levelCoins;
+		playerSphere->SetScore(0);
+		enemySphere->SetScore(0);
+		rootSequence->Reset();
+		pathfindingNodes.clear();
+	}
+	if (!physics->RestoreState(levelStart)) {
+		SetGameState(currentLevel); // something was added or deleted, so build it all again
+		return;
+	}
+	InitLevelCamera();
+}
+
+void CourseworkGame::InitLevelCamera() {
+	if (currentLevel == 1) {
+		world->GetMainCamera()->SetPosition(Vector3(-117.6f, 16.6f, -31.8f));
+		world->GetMainCamera()->SetPitch(-10.3f);
+		world->GetMainCamera()->SetYaw(238.0f);
+	}
+	else if (currentLevel == 2) {
+		world->GetMainCamera()->SetPosition(Vector3(23.4f, 571.6f, -74.8f));
+		world->GetMainCamera()->SetPitch(-82.72f);
+		world->GetMainCamera()->SetYaw(180.7f);
+	}
 }
 
 void CourseworkGame::UpdateWreckingBall() {
@@ -280,7 +425,7 @@ void CourseworkGame::L1Gameplay() {
 	}
 
 	if (currentPos.y < -280.0f) { // Fallen off the edge, respawn
-		LoadLevel1();
+		RestartLevel();
 	}
 }
 
@@ -300,13 +445,13 @@ void CourseworkGame::Pathfinding(Vector3 startPos, Vector3 endPos) {
 void CourseworkGame::LoadLevel2() {
 	world->ClearAndErase();
 	physics->Clear();
-	pistonPlatforms.clear();
+	pistons.clear();
+	balancingPlanes.clear();
 	coins.clear();
 	currentLevel = 2;
+	physics->SetBroadPhaseStructure(BroadPhaseStructure::QuadTree); // a flat maze
 	GenerateAIBehaviour();
-	world->GetMainCamera()->SetPosition(Vector3(23.4f, 571.6f, -74.8f));
-	world->GetMainCamera()->SetPitch(-82.72f);
-	world->GetMainCamera()->SetYaw(180.7f);
+	InitLevelCamera();
 
 	// Gameplay ball
 	playerSphere = AddSphereToWorld(Vector3(-160.0f, 10.0f, 140.0f), 5.0f, 3.0f); // player starting in top right
@@ -368,6 +513,9 @@ void CourseworkGame::LoadLevel2() {
 	AddCoinToWorld(Vector3(-60.0f, 10.0f, 60.0f));
 	AddCoinToWorld(Vector3(10.0f, 10.0f, 10.0f));
 	AddCoinToWorld(Vector3(-10.0f, 10.0f, -10.0f));
+
+	levelCoins = coins;
+	physics->SaveState(levelStart);
 }
 
 void CourseworkGame::L2Gameplay(float dt) {
@@ -424,7 +572,7 @@ void CourseworkGame::L2Gameplay(float dt) {
 		}
 	}
 	if (playerPos.y < -280.0f) { // Fallen off the edge, respawn
-		LoadLevel2();
+		RestartLevel();
 	}
 }
 
@@ -462,16 +610,18 @@ void CourseworkGame::InitialiseWreckingBall() {
 	GameObject* start = AddCubeToWorld(startPos + Vector3(0.0f, 0.0f, 0.0f), cubeSize, 0.0f);
 	wreckingBallEnd = AddCubeToWorld(startPos + Vector3(0.0f, (numLinks + 2.0f) * -cubeDistance, 0.0f), cubeSize, invCubeMass);
 	
-	GameObject* previous = start;
+	// solved as one chain, so the heavy end can't stretch the links between iterations
+	std::vector<GameObject*> links = { start };
+	std::vector<float> distances;
 	
 	for (int i = 0; i < numLinks; ++i) {
 		GameObject* block = AddCubeToWorld(startPos + Vector3(0.0f, (i + 1) * -cubeDistance, 0.0f), cubeSize, invCubeMass);
-		PositionConstraint* constraint = new PositionConstraint(previous, block, maxDistance);
-		world->AddConstraint(constraint);
-		previous = block;
+		links.emplace_back(block);
+		distances.emplace_back(maxDistance);
 	}
-	PositionConstraint* constraint = new PositionConstraint(previous, wreckingBallEnd, maxDistance);
-	world->AddConstraint(constraint);
+	links.emplace_back(wreckingBallEnd);
+	distances.emplace_back(maxDistance);
+	world->AddConstraint(new ChainConstraint(links, distances));
 }
 
 GameObject* CourseworkGame::AddAABBFloorToWorld(const Vector3& position, const Vector3& floorSize, const Vector4& colour, bool isSpring) {
@@ -550,6 +700,7 @@ GameObject* CourseworkGame::AddBalancingPlatformToWorld(const Vector3& position,
 
 	BalancingPlaneConstraint* pc = new BalancingPlaneConstraint(platform, Vector3(0.0f, 1.0f, 0.0f));
 	world->AddConstraint(pc);
+	balancingPlanes.push_back(pc);
 
 	world->AddGameObject(platform);
 	return platform;
@@ -577,7 +728,7 @@ GameObject* CourseworkGame::AddPistonPlatformToWorld(const Vector3& position, co
 
 	PistonConstraint* pc = new PistonConstraint(platform, pistonMovementConstraint);
 	world->AddConstraint(pc);
-	pistonPlatforms.push_back(platform);
+	pistons.push_back(pc);
 
 	world->AddGameObject(platform);
 	return platform;
@@ -670,10 +821,11 @@ bool CourseworkGame::SelectObject() {
 		}
 		*/
 
-		Ray ray = CollisionDetection::BuildRayFromMouse(*world->GetMainCamera());
+		Ray ray = CollisionDetection::BuildRayFromMouse(*world->GetMainCamera(),
+			Window::GetMouse()->GetAbsolutePosition(), Window::GetWindow()->GetScreenSize());
 
 		RayCollision closestCollision;
-		if (world->Raycast(ray, closestCollision, true)) {
+		if (physics->Raycast(ray, closestCollision)) {
 			selectionObject = (GameObject*)closestCollision.node;
 			selectionObject->GetRenderObject()->SetColour(Vector4(0.0f, 1.0f, 0.0f, 1.0f));
 
@@ -766,18 +918,12 @@ void CourseworkGame::GenerateAIBehaviour() {
 	BehaviourAction* lookForPlayer = new BehaviourAction("Go To Player", [&](float dt, BehaviourState state)->BehaviourState {
 		if (state == Initialise) {
 			if (coins.size() > 0) {
-				PowerupDistance p;
-
-				for (auto& i : coins) {
-					float newPowerupPos = Vector3::Dot(enemySphere->GetTransform().GetPosition(), i->GetTransform().GetPosition());
-					if (newPowerupPos < p.distance) {
-						p = PowerupDistance(p.gameObj, p.distance);
-					}
-				}
+				Vector3 enemyPos	= enemySphere->GetTransform().GetPosition();
+				GameObject* coin	= NearestCoin(enemyPos);
 
 				// if distance to the closest power up < distance to the player
-				if (p.distance < Vector3::Dot(enemySphere->GetTransform().GetPosition(), playerSphere->GetTransform().GetPosition())) {
-					aiTarget = p.gameObj;
+				if (coin && (coin->GetTransform().GetPosition() - enemyPos).Length() < (playerSphere->GetTransform().GetPosition() - enemyPos).Length()) {
+					aiTarget = coin;
 					return Failure;
 				}
 				else {
@@ -816,7 +962,10 @@ void CourseworkGame::GenerateAIBehaviour() {
 			if (coins.size() == 0) {
 				return Failure;
 			}
-			aiTarget = coins[(rand() % coins.size())];
+			aiTarget = NearestCoin(enemySphere->GetTransform().GetPosition());
+			if (!aiTarget) {
+				return Failure;
+			}
 			state = Ongoing;
 		}
 		else if (state == Ongoing) {
@@ -844,6 +993,13 @@ void CourseworkGame::GenerateAIBehaviour() {
 	rootSequence->AddChild(selection);
 }
 
+GameObject* CourseworkGame::NearestCoin(const Vector3& position) {
+	// the physics quadtree can still hold coins that were collected since it was last built
+	return physics->NearestObject(position, [&](GameObject* o) {
+		return std::find(coins.begin(), coins.end(), o) != coins.end();
+	});
+}
+
 void CourseworkGame::UpdateAIBehaviour(float dt) {
 	if (!rootSequence) {
 		return;
@@ -9,6 +9,8 @@
 
 namespace NCL {
 	namespace CSC8503 {
+		class PistonConstraint;
+		class BalancingPlaneConstraint;
 
 		class CourseworkGame {
 		public:
@@ -27,12 +29,14 @@ namespace NCL {
 
 			void LoadLevel1();
 			void LoadLevel2();
+			void RestartLevel();
+			void InitLevelCamera();
 
 			void DisplayPathfinding();
 			void Pathfinding(Vector3 startPos, Vector3 endPos);
 			std::vector<Vector3> pathfindingNodes;
-			GameObject* playerSphere;
-			GameObject* enemySphere;
+			GameObject* playerSphere = nullptr;
+			GameObject* enemySphere = nullptr;
 
 			// L1 Gameplay
 			void UpdateWreckingBall();
@@ -57,11 +61,13 @@ namespace NCL {
 			GameObject* AddCapsuleToWorld(const Vector3& position, float halfHeight, float radius, float inverseMass = 10.0f, bool isSpring = false);
 
 			void MainMenu(const std::string& title = "", const Vector4& colour = Vector4(1,1,1,1));
+			void DrawPhysicsProfile();
 			std::string GetTime();
 
 			// AI
 			void GenerateAIBehaviour();
 			void UpdateAIBehaviour(float dt);
+			GameObject* NearestCoin(const Vector3& position);
 			BehaviourSequence* rootSequence;
 			GameObject* aiTarget;
 
@@ -71,6 +77,8 @@ namespace NCL {
 
 			float		forceMagnitude;
 
+			std::vector<Vector3> physicsFocus; // where the physics LOD keeps bodies at full rate
+
 			GameObject* selectionObject = nullptr;
 			GameObject* forwardObject = nullptr; // Tutorial 1 Q.2
 
@@ -84,14 +92,18 @@ namespace NCL {
 			//Coursework Additional functionality	
 			GameObject* lockedObject	= nullptr;
 			Vector3 lockedOffset		= Vector3(0, 14, 20);
+			bool showPhysicsProfile		= false;
 			void LockCameraToObject(GameObject* o) {
 				lockedObject = o;
 			}
 
 		private:
 			std::chrono::time_point<std::chrono::system_clock> gameTime;
-			std::vector<GameObject*> pistonPlatforms;
+			std::vector<PistonConstraint*> pistons;
+			std::vector<BalancingPlaneConstraint*> balancingPlanes;
 			std::vector<GameObject*> coins;
+			std::vector<GameObject*> levelCoins;	// every coin the level started with, collected or not
+			std::vector<char> levelStart;			// the physics state of every object as the level began
 			Window* window;
 			
 			int currentLevel = 0;
@@ -163,18 +175,6 @@ namespace NCL {
 			int minChoice;
 			int maxChoice;
 		};
-		struct PowerupDistance {
-			PowerupDistance() {
-				this->gameObj = nullptr;
-				distance = FLT_MAX;
-			}
-			PowerupDistance(GameObject* g, float d) {
-				this->gameObj = g;
-				this->distance = d;
-			}
-			GameObject* gameObj;
-			float distance;
-		};
 	}
 }
 
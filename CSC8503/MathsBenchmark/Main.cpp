@@ -0,0 +1,584 @@
+#include "../../Common/Vector3.h"
+#include "../../Common/Vector4.h"
+#include "../../Common/Matrix3.h"
+#include "../../Common/Matrix4.h"
+#include "../../Common/Quaternion.h"
+#include "../../Common/Plane.h"
+#include "../../Common/PaddedQuaternion.h"
+#include "../../Common/FastMaths.h"
+#include "../../Common/GameTimer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <random>
+#include <cmath>
+#include <cfloat>
+#include <limits>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace NCL;
+using namespace Maths;
+
+/*
+	Times the maths library's hot operations, and measures how far each one's
+	results are from the same sums done in double precision. Errors are given
+	in ULPs (units in the last place) - how many floats away from the right
+	answer a result is. For vectors and matrices, that's measured against the
+	spacing of floats around the largest element of the answer, so a tiny
+	element that has cancelled down to nearly nothing doesn't swamp the rest.
+*/
+
+std::mt19937 randomGenerator;
+
+float RandomRange(float min, float max) {
+	return std::uniform_real_distribution<float>(min, max)(randomGenerator);
+}
+
+typedef std::array<double, 3>	DVector3;
+typedef std::array<double, 4>	DQuaternion; // x, y, z, w, the same as Quaternion
+typedef std::array<double, 9>	DMatrix3;
+typedef std::array<double, 16>	DMatrix4;
+
+template <size_t n>
+std::array<double, n> ToDouble(const float* f) {
+	std::array<double, n> d;
+	for (size_t i = 0; i < n; ++i) {
+		d[i] = f[i];
+	}
+	return d;
+}
+
+// The gap between a float the size of this value and the next one up
+double ULPOf(double value) {
+	float f = std::abs((float)value);
+	return std::max((double)(std::nextafter(f, FLT_MAX) - f), (double)std::numeric_limits<float>::denorm_min());
+}
+
+template <size_t n>
+double ULPError(const float* result, const std::array<double, n>& reference) {
+	double largest	= 0.0;
+	double error	= 0.0;
+	for (size_t i = 0; i < n; ++i) {
+		largest	= std::max(largest, std::abs(reference[i]));
+		error	= std::max(error, std::abs(result[i] - reference[i]));
+	}
+	return error / ULPOf(largest);
+}
+
+DVector3 Normalised(const DVector3& v) {
+	double length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	return DVector3{ v[0] / length, v[1] / length, v[2] / length };
+}
+
+DVector3 Cross(const DVector3& a, const DVector3& b) {
+	return DVector3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+double Dot(const DVector3& a, const DVector3& b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Both column major, like Matrix4
+DMatrix4 Multiply(const DMatrix4& a, const DMatrix4& b) {
+	DMatrix4 out;
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			double sum = 0.0;
+			for (int i = 0; i < 4; ++i) {
+				sum += a[c + (i * 4)] * b[(r * 4) + i];
+			}
+			out[c + (r * 4)] = sum;
+		}
+	}
+	return out;
+}
+
+DMatrix3 Multiply(const DMatrix3& a, const DMatrix3& b) {
+	DMatrix3 out;
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 3; ++c) {
+			double sum = 0.0;
+			for (int i = 0; i < 3; ++i) {
+				sum += a[c + (i * 3)] * b[(r * 3) + i];
+			}
+			out[c + (r * 3)] = sum;
+		}
+	}
+	return out;
+}
+
+// Gauss-Jordan elimination with partial pivoting - slow, but about as accurate as it gets
+DMatrix4 Inverse(DMatrix4 m) {
+	DMatrix4 out = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+	auto at = [](DMatrix4& a, int row, int column) -> double& {
+		return a[row + column * 4];
+	};
+	for (int column = 0; column < 4; ++column) {
+		int pivot = column;
+		for (int row = column + 1; row < 4; ++row) {
+			if (std::abs(at(m, row, column)) > std::abs(at(m, pivot, column))) {
+				pivot = row;
+			}
+		}
+		for (int i = 0; i < 4; ++i) {
+			std::swap(at(m, column, i), at(m, pivot, i));
+			std::swap(at(out, column, i), at(out, pivot, i));
+		}
+		double scale = 1.0 / at(m, column, column);
+		for (int i = 0; i < 4; ++i) {
+			at(m, column, i)	*= scale;
+			at(out, column, i)	*= scale;
+		}
+		for (int row = 0; row < 4; ++row) {
+			if (row == column) {
+				continue;
+			}
+			double factor = at(m, row, column);
+			for (int i = 0; i < 4; ++i) {
+				at(m, row, i)	-= factor * at(m, column, i);
+				at(out, row, i)	-= factor * at(out, column, i);
+			}
+		}
+	}
+	return out;
+}
+
+DVector3 TransformPoint(const DMatrix4& m, const Vector3& p) {
+	DVector3 out;
+	for (int i = 0; i < 3; ++i) {
+		out[i] = m[i] * p.x + m[i + 4] * p.y + m[i + 8] * p.z + m[i + 12];
+	}
+	return out;
+}
+
+DMatrix3 RotationMatrix(const Quaternion& q) {
+	double x = q.x, y = q.y, z = q.z, w = q.w;
+	return DMatrix3{
+		1 - 2 * (y * y + z * z),	2 * (x * y + z * w),		2 * (x * z - y * w),
+		2 * (x * y - z * w),		1 - 2 * (x * x + z * z),	2 * (y * z + x * w),
+		2 * (x * z + y * w),		2 * (y * z - x * w),		1 - 2 * (x * x + y * y)
+	};
+}
+
+DMatrix4 RotationMatrix4(const Quaternion& q) {
+	DMatrix3 r = RotationMatrix(q);
+	return DMatrix4{
+		r[0], r[1], r[2], 0,
+		r[3], r[4], r[5], 0,
+		r[6], r[7], r[8], 0,
+		0, 0, 0, 1
+	};
+}
+
+DQuaternion Multiply(const DQuaternion& a, const DQuaternion& b) {
+	return DQuaternion{
+		a[0] * b[3] + a[3] * b[0] + a[1] * b[2] - a[2] * b[1],
+		a[1] * b[3] + a[3] * b[1] + a[2] * b[0] - a[0] * b[2],
+		a[2] * b[3] + a[3] * b[2] + a[0] * b[1] - a[1] * b[0],
+		a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2]
+	};
+}
+
+// q * v * q', the long way round
+DVector3 Rotate(const Quaternion& q, const Vector3& v) {
+	DQuaternion dq = ToDouble<4>(q.array);
+	DQuaternion conjugate{ -dq[0], -dq[1], -dq[2], dq[3] };
+	DQuaternion out = Multiply(Multiply(dq, DQuaternion{ v.x, v.y, v.z, 0.0 }), conjugate);
+	return DVector3{ out[0], out[1], out[2] };
+}
+
+DQuaternion Slerp(const Quaternion& from, const Quaternion& to, double by) {
+	DQuaternion a = ToDouble<4>(from.array);
+	DQuaternion b = ToDouble<4>(to.array);
+	double cosAngle = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+	if (cosAngle < 0.0) {
+		cosAngle = -cosAngle;
+		for (double& d : b) {
+			d = -d;
+		}
+	}
+	double angle	= std::acos(std::min(cosAngle, 1.0));
+	double fromBy	= 1.0 - by;
+	double toBy		= by;
+	if (angle > 1e-9) {
+		fromBy	= std::sin((1.0 - by) * angle) / std::sin(angle);
+		toBy	= std::sin(by * angle) / std::sin(angle);
+	}
+	DQuaternion out;
+	for (int i = 0; i < 4; ++i) {
+		out[i] = a[i] * fromBy + b[i] * toBy;
+	}
+	return out;
+}
+
+/*
+	The inputs every operation works through, made once so that they're the
+	same from run to run and from one build to the next.
+*/
+struct MathsData {
+	std::vector<Vector3>	points;
+	std::vector<Vector3>	directions;
+	std::vector<Quaternion> rotations;
+	std::vector<Matrix3>	matrix3s;
+	std::vector<Matrix4>	matrix4s;
+	std::vector<Plane>		planes;
+	std::vector<float>		lengths;
+
+	MathsData(int count) {
+		randomGenerator.seed(count);
+		for (int i = 0; i < count; ++i) {
+			points.emplace_back(RandomRange(-100, 100), RandomRange(-100, 100), RandomRange(-100, 100));
+			directions.emplace_back(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1) + 2.0f);
+
+			Quaternion q(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1));
+			q.Normalise();
+			rotations.emplace_back(q);
+
+			Vector3 scale(RandomRange(0.5f, 2), RandomRange(0.5f, 2), RandomRange(0.5f, 2));
+			matrix3s.emplace_back(Matrix3(q) * Matrix3::Scale(scale));
+			matrix4s.emplace_back(Matrix4::Translation(points.back()) * Matrix4(q) * Matrix4::Scale(scale));
+
+			planes.emplace_back(directions.back().Normalised(), RandomRange(-100, 100));
+			lengths.emplace_back(std::exp(RandomRange(-10, 10)));
+		}
+	}
+};
+
+struct MathsResult {
+	std::string name;
+	double		nsPerOp;
+	double		maxULP;
+	double		meanULP;
+	bool		exact;	// nothing to be inaccurate about - it's just moving floats around
+};
+
+/*
+	Runs work (which does the operation once for every input, writing its
+	results somewhere) repeats times, then hands each result to error to
+	compare against a double precision reference.
+*/
+template <typename Work, typename Error>
+MathsResult Measure(const std::string& name, int count, int repeats, Work&& work, Error&& error) {
+	work(); // warm the caches up first
+	GameTimer timer;
+	for (int r = 0; r < repeats; ++r) {
+		work();
+	}
+	timer.Tick();
+
+	MathsResult result{ name, timer.GetTimeDeltaMSec() * 1000000.0 / ((double)repeats * count), 0.0, 0.0, false };
+	for (int i = 0; i < count; ++i) {
+		double e = error(i);
+		result.maxULP	= std::max(result.maxULP, e);
+		result.meanULP	+= e / count;
+	}
+	return result;
+}
+
+template <typename Work>
+MathsResult MeasureExact(const std::string& name, int count, int repeats, Work&& work) {
+	MathsResult result = Measure(name, count, repeats, work, [](int) { return 0.0; });
+	result.exact = true;
+	return result;
+}
+
+// The multiply Matrix4 had before it was vectorised, as a baseline
+Matrix4 ScalarMultiply(const Matrix4& m, const Matrix4& a) {
+	Matrix4 out;
+	for (unsigned int r = 0; r < 4; ++r) {
+		for (unsigned int c = 0; c < 4; ++c) {
+			out.array[c + (r * 4)] = 0.0f;
+			for (unsigned int i = 0; i < 4; ++i) {
+				out.array[c + (r * 4)] += m.array[c + (i * 4)] * a.array[(r * 4) + i];
+			}
+		}
+	}
+	return out;
+}
+
+// 4 lanes at a time, with any left over that don't fill a vector done one at a time
+template <class Policy>
+void InvSqrt4(const std::vector<float>& in, std::vector<float>& out) {
+	size_t i = 0;
+	for (; i + 4 <= in.size(); i += 4) {
+		SIMD::Store(&out[i], InvSqrt<Policy>(SIMD::Load(&in[i])));
+	}
+	for (; i < in.size(); ++i) {
+		out[i] = InvSqrt<Policy>(in[i]);
+	}
+}
+
+std::vector<MathsResult> RunMathsBenchmarks(int count, int repeats) {
+	MathsData d(count);
+	std::vector<MathsResult> results;
+	auto next = [count](int i) {
+		return (i + 1) % count;
+	};
+
+	std::vector<float> floats(count);
+	results.emplace_back(Measure("InvSqrt precise", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) floats[i] = InvSqrt<PreciseMaths>(d.lengths[i]); },
+		[&](int i) { return ULPError(&floats[i], std::array<double, 1>{ 1.0 / std::sqrt((double)d.lengths[i]) }); }));
+	results.emplace_back(Measure("InvSqrt fast", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) floats[i] = InvSqrt<FastMaths>(d.lengths[i]); },
+		[&](int i) { return ULPError(&floats[i], std::array<double, 1>{ 1.0 / std::sqrt((double)d.lengths[i]) }); }));
+	results.emplace_back(Measure("InvSqrt precise 4-wide", count, repeats,
+		[&]() { InvSqrt4<PreciseMaths>(d.lengths, floats); },
+		[&](int i) { return ULPError(&floats[i], std::array<double, 1>{ 1.0 / std::sqrt((double)d.lengths[i]) }); }));
+	results.emplace_back(Measure("InvSqrt fast 4-wide", count, repeats,
+		[&]() { InvSqrt4<FastMaths>(d.lengths, floats); },
+		[&](int i) { return ULPError(&floats[i], std::array<double, 1>{ 1.0 / std::sqrt((double)d.lengths[i]) }); }));
+
+	std::vector<Vector3> vectors(count);
+	results.emplace_back(Measure("Vector3::Normalised precise", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.points[i].Normalised<PreciseMaths>(); },
+		[&](int i) { return ULPError(vectors[i].array, Normalised(ToDouble<3>(d.points[i].array))); }));
+	results.emplace_back(Measure("Vector3::Normalised fast", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.points[i].Normalised<FastMaths>(); },
+		[&](int i) { return ULPError(vectors[i].array, Normalised(ToDouble<3>(d.points[i].array))); }));
+	results.emplace_back(Measure("Vector3::Cross", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = Vector3::Cross(d.points[i], d.directions[i]); },
+		[&](int i) { return ULPError(vectors[i].array, Cross(ToDouble<3>(d.points[i].array), ToDouble<3>(d.directions[i].array))); }));
+	results.emplace_back(Measure("MulAdd(Vector3) precise", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = MulAdd<PreciseMaths>(d.directions[i], d.lengths[i], d.points[i]); },
+		[&](int i) {
+			DVector3 reference;
+			for (int j = 0; j < 3; ++j) {
+				reference[j] = (double)d.directions[i][j] * d.lengths[i] + d.points[i][j];
+			}
+			return ULPError(vectors[i].array, reference);
+		}));
+	results.emplace_back(Measure("MulAdd(Vector3) fast", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = MulAdd<FastMaths>(d.directions[i], d.lengths[i], d.points[i]); },
+		[&](int i) {
+			DVector3 reference;
+			for (int j = 0; j < 3; ++j) {
+				reference[j] = (double)d.directions[i][j] * d.lengths[i] + d.points[i][j];
+			}
+			return ULPError(vectors[i].array, reference);
+		}));
+
+	std::vector<Matrix3> matrix3s(count);
+	results.emplace_back(Measure("Matrix3 * Matrix3", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix3s[i] = d.matrix3s[i] * d.matrix3s[next(i)]; },
+		[&](int i) { return ULPError(matrix3s[i].array, Multiply(ToDouble<9>(d.matrix3s[i].array), ToDouble<9>(d.matrix3s[next(i)].array))); }));
+	results.emplace_back(Measure("Matrix3 * Vector3", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.matrix3s[i] * d.points[i]; },
+		[&](int i) {
+			DVector3 reference;
+			for (int j = 0; j < 3; ++j) {
+				reference[j] = (double)d.matrix3s[i].array[j] * d.points[i].x + (double)d.matrix3s[i].array[j + 3] * d.points[i].y + (double)d.matrix3s[i].array[j + 6] * d.points[i].z;
+			}
+			return ULPError(vectors[i].array, reference);
+		}));
+	results.emplace_back(Measure("Matrix3(Quaternion)", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix3s[i] = Matrix3(d.rotations[i]); },
+		[&](int i) { return ULPError(matrix3s[i].array, RotationMatrix(d.rotations[i])); }));
+	results.emplace_back(MeasureExact("Matrix3::Absolute", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix3s[i] = d.matrix3s[i].Absolute(); }));
+	results.emplace_back(MeasureExact("Matrix3::Transposed", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix3s[i] = d.matrix3s[i].Transposed(); }));
+
+	std::vector<Matrix4> matrix4s(count);
+	auto productError = [&](int i) {
+		return ULPError(matrix4s[i].array, Multiply(ToDouble<16>(d.matrix4s[i].array), ToDouble<16>(d.matrix4s[next(i)].array)));
+	};
+	results.emplace_back(Measure("Matrix4 * Matrix4 scalar", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix4s[i] = ScalarMultiply(d.matrix4s[i], d.matrix4s[next(i)]); },
+		productError));
+	results.emplace_back(Measure("Matrix4 * Matrix4", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix4s[i] = d.matrix4s[i] * d.matrix4s[next(i)]; },
+		productError));
+	results.emplace_back(Measure("Matrix4::Inverse", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix4s[i] = d.matrix4s[i].Inverse(); },
+		[&](int i) { return ULPError(matrix4s[i].array, Inverse(ToDouble<16>(d.matrix4s[i].array))); }));
+	results.emplace_back(Measure("Matrix4::AffineInverse", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix4s[i] = d.matrix4s[i].AffineInverse(); },
+		[&](int i) { return ULPError(matrix4s[i].array, Inverse(ToDouble<16>(d.matrix4s[i].array))); }));
+	results.emplace_back(Measure("Matrix4(Quaternion)", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) matrix4s[i] = Matrix4(d.rotations[i]); },
+		[&](int i) { return ULPError(matrix4s[i].array, RotationMatrix4(d.rotations[i])); }));
+	auto pointError = [&](int i) {
+		return ULPError(vectors[i].array, TransformPoint(ToDouble<16>(d.matrix4s[i].array), d.points[i]));
+	};
+	results.emplace_back(Measure("Matrix4 * Vector3", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.matrix4s[i] * d.points[i]; },
+		pointError));
+	results.emplace_back(Measure("Matrix4::TransformPoint", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.matrix4s[i].TransformPoint(d.points[i]); },
+		pointError));
+
+	std::vector<Quaternion> quaternions(count);
+	auto quaternionProductError = [&](int i) {
+		return ULPError(quaternions[i].array, Multiply(ToDouble<4>(d.rotations[i].array), ToDouble<4>(d.rotations[next(i)].array)));
+	};
+	results.emplace_back(Measure("Quaternion * Quaternion", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) quaternions[i] = d.rotations[i] * d.rotations[next(i)]; },
+		quaternionProductError));
+	results.emplace_back(Measure("PaddedQuaternion * PaddedQuaternion", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) quaternions[i] = (PaddedQuaternion(d.rotations[i]) * PaddedQuaternion(d.rotations[next(i)])).ToQuaternion(); },
+		quaternionProductError));
+	auto rotationError = [&](int i) {
+		return ULPError(vectors[i].array, Rotate(d.rotations[i], d.points[i]));
+	};
+	results.emplace_back(Measure("Quaternion * Vector3", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = d.rotations[i] * d.points[i]; },
+		rotationError));
+	results.emplace_back(Measure("PaddedQuaternion * PaddedVector3", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) vectors[i] = (PaddedQuaternion(d.rotations[i]) * PaddedVector3(d.points[i])).ToVector3(); },
+		rotationError));
+	auto normaliseError = [&](int i) {
+		DQuaternion q = Multiply(ToDouble<4>(d.rotations[i].array), ToDouble<4>(d.rotations[next(i)].array));
+		double length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (double& e : q) {
+			e /= length;
+		}
+		return ULPError(quaternions[i].array, q);
+	};
+	results.emplace_back(Measure("Quaternion::Normalise", count, repeats,
+		[&]() {
+			for (int i = 0; i < count; ++i) {
+				quaternions[i] = d.rotations[i] * d.rotations[next(i)];
+				quaternions[i].Normalise();
+			}
+		}, normaliseError));
+	results.emplace_back(Measure("PaddedQuaternion::Normalised", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) quaternions[i] = (PaddedQuaternion(d.rotations[i]) * PaddedQuaternion(d.rotations[next(i)])).Normalised().ToQuaternion(); },
+		normaliseError));
+	results.emplace_back(Measure("Quaternion::Slerp", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) quaternions[i] = Quaternion::Slerp(d.rotations[i], d.rotations[next(i)], d.lengths[i] / (d.lengths[i] + 1.0f)); },
+		[&](int i) { return ULPError(quaternions[i].array, Slerp(d.rotations[i], d.rotations[next(i)], d.lengths[i] / (d.lengths[i] + 1.0f))); }));
+
+	results.emplace_back(Measure("Plane::DistanceFromPlane", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) floats[i] = d.planes[i].DistanceFromPlane(d.points[i]); },
+		[&](int i) {
+			double distance = Dot(ToDouble<3>(d.planes[i].GetNormal().array), ToDouble<3>(d.points[i].array)) + d.planes[i].GetDistance();
+			return ULPError(&floats[i], std::array<double, 1>{ distance });
+		}));
+	std::vector<Plane> planes(count);
+	results.emplace_back(Measure("Plane::PlaneFromTri", count, repeats,
+		[&]() { for (int i = 0; i < count; ++i) planes[i] = Plane::PlaneFromTri(d.points[i], d.points[next(i)], d.points[next(next(i))]); },
+		[&](int i) {
+			DVector3 v0 = ToDouble<3>(d.points[i].array);
+			DVector3 v1 = ToDouble<3>(d.points[next(i)].array);
+			DVector3 v2 = ToDouble<3>(d.points[next(next(i))].array);
+			DVector3 normal = Normalised(Cross(DVector3{ v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] }, DVector3{ v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] }));
+			Vector3 n = planes[i].GetNormal();
+			return ULPError(n.array, normal);
+		}));
+	return results;
+}
+
+/*
+	Reads back the results another run wrote, so that the numbers from before
+	a change can be put next to the ones from after it.
+*/
+std::map<std::string, MathsResult> ReadCSV(const std::string& filename) {
+	std::map<std::string, MathsResult> results;
+	std::ifstream file(filename);
+	std::string line;
+	std::getline(file, line); // the header
+	while (std::getline(file, line)) {
+		std::stringstream s(line);
+		MathsResult r;
+		std::string field;
+		std::getline(s, r.name, ',');
+		std::getline(s, field, ',');	r.nsPerOp	= atof(field.c_str());
+		std::getline(s, field, ',');	r.maxULP	= atof(field.c_str());
+		std::getline(s, field, ',');	r.meanULP	= atof(field.c_str());
+		r.exact = false;
+		results[r.name] = r;
+	}
+	return results;
+}
+
+void WriteCSV(const std::string& filename, const std::vector<MathsResult>& results) {
+	std::ofstream file(filename);
+	file << "operation,ns_per_op,max_ulp,mean_ulp\n";
+	for (const MathsResult& r : results) {
+		file << r.name << "," << r.nsPerOp << "," << r.maxULP << "," << r.meanULP << "\n";
+	}
+}
+
+/*
+	Usage: MathsBenchmark [-count inputs] [-repeats count] [-out filename] [-compare filename]
+	Writes every result to filename.csv. Given the csv from an earlier run,
+	-compare prints how much faster or slower each operation has become.
+*/
+int main(int argc, char** argv) {
+	int			count		= 10000;
+	int			repeats		= 100;
+	std::string outName		= "MathsBenchmark";
+	std::string compareName;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "-count") {
+			count = std::max(3, atoi(argv[i + 1]));
+		}
+		else if (arg == "-repeats") {
+			repeats = std::max(1, atoi(argv[i + 1]));
+		}
+		else if (arg == "-out") {
+			outName = argv[i + 1];
+		}
+		else if (arg == "-compare") {
+			compareName = argv[i + 1];
+		}
+	}
+
+	std::map<std::string, MathsResult> before;
+	if (!compareName.empty()) {
+		before = ReadCSV(compareName);
+	}
+
+	std::vector<MathsResult> results = RunMathsBenchmarks(count, repeats);
+
+#if defined(NCL_SSE)
+	std::cout << "SSE";
+#elif defined(NCL_NEON)
+	std::cout << "NEON";
+#else
+	std::cout << "No SIMD";
+#endif
+#if defined(NCL_FMA)
+	std::cout << " with FMA";
+#endif
+#if defined(NCL_FAST_MATHS)
+	std::cout << ", NCL_FAST_MATHS";
+#endif
+	std::cout << ", " << count << " inputs, " << repeats << " repeats" << std::endl;
+
+	std::cout << std::left << std::setw(38) << "Operation" << std::right << std::setw(10) << "ns/op"
+		<< std::setw(12) << "max ULP" << std::setw(12) << "mean ULP";
+	if (!before.empty()) {
+		std::cout << std::setw(12) << "ns before" << std::setw(10) << "speedup";
+	}
+	std::cout << std::endl << std::fixed;
+
+	for (const MathsResult& r : results) {
+		std::cout << std::left << std::setw(38) << r.name << std::right << std::setprecision(2) << std::setw(10) << r.nsPerOp;
+		if (r.exact) {
+			std::cout << std::setw(12) << "exact" << std::setw(12) << "exact";
+		}
+		else {
+			std::cout << std::setprecision(1) << std::setw(12) << r.maxULP << std::setprecision(3) << std::setw(12) << r.meanULP;
+		}
+		auto old = before.find(r.name);
+		if (old != before.end()) {
+			std::cout << std::setprecision(2) << std::setw(12) << old->second.nsPerOp << std::setw(9) << old->second.nsPerOp / r.nsPerOp << "x";
+		}
+		std::cout << std::endl;
+	}
+
+	WriteCSV(outName + ".csv", results);
+	std::cout << "Wrote " << results.size() << " results to " << outName << ".csv" << std::endl;
+	return 0;
+}
@@ -0,0 +1,749 @@
+#include "../CSC8503Common/GameWorld.h"
+#include "../CSC8503Common/PhysicsSystem.h"
+#include "../CSC8503Common/GameObject.h"
+#include "../CSC8503Common/QuadTree.h"
+#include "../CSC8503Common/Constraint.h"
+#include "../../Common/GameTimer.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+using namespace NCL;
+using namespace CSC8503;
+
+/*
+	Every heap allocation made by this program goes through here, so we can
+	see exactly how many allocations each frame's broadphase rebuild makes.
+*/
+static size_t allocationCount = 0;
+
+void* operator new(size_t size) {
+	allocationCount++;
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+std::mt19937 randomGenerator(1);
+
+float RandomRange(float min, float max) {
+	return std::uniform_real_distribution<float>(min, max)(randomGenerator);
+}
+
+float RandomNormal(float sigma) {
+	return std::normal_distribution<float>(0.0f, sigma)(randomGenerator);
+}
+
+struct BenchObject {
+	Vector3 position;
+	Vector3 velocity;
+	Vector3 halfSize;
+};
+
+/*
+	Moves a few thousand boxes around the quadtree's area, rebuilding the tree
+	and finding every pair each frame, just as PhysicsSystem::BroadPhase
+	does. The first few frames grow the pools; after that, a rebuild shouldn't
+	allocate at all.
+*/
+void BenchmarkQuadTreeAllocations(int objectCount, int frameCount) {
+	std::vector<BenchObject> objects(objectCount);
+	for (BenchObject& o : objects) {
+		o.position	= Vector3(RandomRange(-1000, 1000), RandomRange(0, 50), RandomRange(-1000, 1000));
+		o.velocity	= Vector3(RandomRange(-20, 20), 0, RandomRange(-20, 20));
+		float size	= RandomRange(0.5f, 10.0f);
+		o.halfSize	= Vector3(size, size, size);
+	}
+	QuadTree<int> tree(Vector2(1024.0f, 1024.0f), 7, 6);
+
+	size_t	firstAllocations	= 0;
+	size_t	steadyAllocations	= 0;
+	int		warmupFrames		= 10;
+
+	for (int frame = 0; frame < frameCount; ++frame) {
+		for (BenchObject& o : objects) {
+			o.position += o.velocity * (1.0f / 120.0f);
+		}
+		size_t allocationsBefore = allocationCount;
+
+		tree.Clear();
+		for (int i = 0; i < objectCount; ++i) {
+			tree.Insert(i, objects[i].position, objects[i].halfSize);
+		}
+		int pairs = 0;
+		tree.OperateOnPairs(
+			[&](QuadTreeEntry<int>& a, QuadTreeEntry<int>& b) {
+				pairs++;
+			}
+		);
+		size_t allocations = allocationCount - allocationsBefore;
+
+		if (frame == 0) {
+			firstAllocations = allocations;
+		}
+		if (frame >= warmupFrames) {
+			steadyAllocations += allocations;
+		}
+	}
+	std::cout << "QuadTree rebuild allocations, " << objectCount << " objects: first frame " << firstAllocations
+		<< ", after " << warmupFrames << " frames " << steadyAllocations << std::endl;
+}
+
+enum class BenchShape	{ Sphere, AABB, OBB, Capsule, Mixed };
+enum class BenchLayout	{ Random, Clustered, Stacked };
+enum class BenchMode	{ BruteForce, QuadTree, Octree };
+
+const char* ShapeName(BenchShape s) {
+	switch (s) {
+		case BenchShape::Sphere:	return "sphere";
+		case BenchShape::AABB:		return "aabb";
+		case BenchShape::OBB:		return "obb";
+		case BenchShape::Capsule:	return "capsule";
+		default:					return "mixed";
+	}
+}
+
+const char* LayoutName(BenchLayout l) {
+	switch (l) {
+		case BenchLayout::Random:		return "random";
+		case BenchLayout::Clustered:	return "clustered";
+		default:						return "stacked";
+	}
+}
+
+const char* ModeName(BenchMode m) {
+	switch (m) {
+		case BenchMode::BruteForce:	return "bruteforce";
+		case BenchMode::QuadTree:	return "quadtree";
+		default:					return "octree";
+	}
+}
+
+GameObject* AddBenchObject(GameWorld& world, BenchShape shape, const Vector3& position, float size) {
+	GameObject* object = new GameObject();
+	Quaternion orientation = Quaternion::AxisAngleToQuaterion(
+		Vector3(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1)).Normalised(), RandomRange(0, 180));
+
+	switch (shape) {
+		case BenchShape::Sphere:
+			object->SetBoundingVolume((CollisionVolume*)new SphereVolume(size));
+			object->GetTransform().SetScale(Vector3(size, size, size));
+			break;
+		case BenchShape::AABB:
+			object->SetBoundingVolume((CollisionVolume*)new AABBVolume(Vector3(size, size, size)));
+			object->GetTransform().SetScale(Vector3(size, size, size) * 2);
+			break;
+		case BenchShape::OBB:
+			object->SetBoundingVolume((CollisionVolume*)new OBBVolume(Vector3(size, size * 0.5f, size)));
+			object->GetTransform().SetScale(Vector3(size, size * 0.5f, size) * 2).SetOrientation(orientation);
+			break;
+		default:
+			object->SetBoundingVolume((CollisionVolume*)new CapsuleVolume(size * 2.0f, size * 0.5f));
+			object->GetTransform().SetScale(Vector3(size, size * 2.0f, size)).SetOrientation(orientation);
+			break;
+	}
+	object->GetTransform().SetPosition(position);
+
+	object->SetPhysicsObject(new PhysicsObject(&object->GetTransform(), object->GetBoundingVolume()));
+	object->GetPhysicsObject()->SetInverseMass(1.0f);
+	if (shape == BenchShape::Sphere || shape == BenchShape::Capsule) {
+		object->GetPhysicsObject()->InitSphereInertia();
+	}
+	else {
+		object->GetPhysicsObject()->InitCubeInertia();
+	}
+	object->GetPhysicsObject()->SetLinearVelocity(Vector3(RandomRange(-1, 1), RandomRange(-1, 1), RandomRange(-1, 1)));
+
+	world.AddGameObject(object);
+	return object;
+}
+
+/*
+	Random scenes spread out as they grow, to keep roughly the same density,
+	clustered scenes pack groups of 200 objects tightly together, and stacked
+	scenes build towers of 10 touching objects - the worst case for the
+	quadtree, whose cells are full height.
+*/
+void BuildScene(GameWorld& world, BenchShape shape, BenchLayout layout, int objectCount) {
+	float areaSize = std::min(1000.0f, std::sqrt((float)objectCount) * 3.0f);
+
+	std::vector<Vector3> clusters;
+	for (int i = 0; i < std::max(1, objectCount / 200); ++i) {
+		clusters.push_back(Vector3(RandomRange(-areaSize, areaSize), RandomRange(0, 50), RandomRange(-areaSize, areaSize)));
+	}
+	int towerHeight = 10;
+	int towerRow	= (int)std::ceil(std::sqrt(objectCount / (float)towerHeight));
+
+	for (int i = 0; i < objectCount; ++i) {
+		BenchShape thisShape = (shape == BenchShape::Mixed) ? (BenchShape)(i % 4) : shape;
+		float size = RandomRange(0.5f, 1.5f);
+
+		Vector3 position;
+		if (layout == BenchLayout::Random) {
+			position = Vector3(RandomRange(-areaSize, areaSize), RandomRange(0, 50), RandomRange(-areaSize, areaSize));
+		}
+		else if (layout == BenchLayout::Clustered) {
+			const Vector3& centre = clusters[i % clusters.size()];
+			position = centre + Vector3(RandomNormal(5.0f), RandomNormal(5.0f), RandomNormal(5.0f));
+		}
+		else {
+			size = 1.0f;
+			int tower = i / towerHeight;
+			position = Vector3(
+				(tower % towerRow - towerRow * 0.5f) * 4.0f,
+				(i % towerHeight) * 1.9f, // slightly overlapping, so every tower is full of contacts
+				(tower / towerRow - towerRow * 0.5f) * 4.0f
+			);
+		}
+		AddBenchObject(world, thisShape, position, size);
+	}
+}
+
+struct BenchResult {
+	std::string shape;
+	std::string layout;
+	std::string mode;
+	int			objects;
+	PhysicsStats perStep; // averaged over every step that was run
+};
+
+BenchResult RunBenchmark(BenchShape shape, BenchLayout layout, BenchMode mode, int objectCount, int steps) {
+	randomGenerator.seed(objectCount * 31 + (int)layout * 7 + (int)shape); // every mode sees the same scene
+
+	GameWorld world;
+	PhysicsSystem physics(world);
+	physics.UseGravity(false);
+	physics.UseBroadPhase(mode != BenchMode::BruteForce);
+	physics.SetBroadPhaseStructure(mode == BenchMode::Octree ? BroadPhaseStructure::Octree : BroadPhaseStructure::QuadTree);
+
+	BuildScene(world, shape, layout, objectCount);
+
+	PhysicsStats total;
+	while (total.steps < steps) {
+		// the physics system may have dropped its rate while a previous run was slow, so some updates won't step at all
+		physics.Update(1.0f / 120.0f);
+		const PhysicsStats& s = physics.GetStats();
+		total.steps				+= s.steps;
+		total.broadphasePairs	+= s.broadphasePairs;
+		total.contacts			+= s.contacts;
+		total.integrateMs		+= s.integrateMs;
+		total.broadphaseMs		+= s.aabbMs + s.broadphaseMs;			// the results have always counted these together...
+		total.narrowphaseMs		+= s.narrowphaseMs + s.resolutionMs;	// ...and these
+		total.constraintMs		+= s.constraintMs;
+	}
+	world.ClearAndErase();
+
+	BenchResult result;
+	result.shape	= ShapeName(shape);
+	result.layout	= LayoutName(layout);
+	result.mode		= ModeName(mode);
+	result.objects	= objectCount;
+
+	float invSteps = 1.0f / total.steps;
+	result.perStep.steps			= total.steps;
+	result.perStep.broadphasePairs	= (int)(total.broadphasePairs * invSteps);
+	result.perStep.contacts			= (int)(total.contacts * invSteps);
+	result.perStep.integrateMs		= total.integrateMs * invSteps;
+	result.perStep.broadphaseMs		= total.broadphaseMs * invSteps;
+	result.perStep.narrowphaseMs	= total.narrowphaseMs * invSteps;
+	result.perStep.constraintMs		= total.constraintMs * invSteps;
+	return result;
+}
+
+/*
+	Hangs chains of spheres from static anchors, like the wrecking ball, and
+	times the constraint solver: one virtual call per constraint, the flat
+	PositionConstraint rows, the rows spread across the worker threads, each
+	chain solved directly as a ChainConstraint, and the links and chains solved
+	by XPBD substeps instead. The more a chain has stretched by the end, the
+	less well its solver is keeping up.
+*/
+void BenchmarkConstraints(int chainCount, int linkCount, int steps) {
+	const char* solverNames[] = { "virtual", "contiguous", "contiguous parallel", "direct chain", "xpbd links", "xpbd chain" };
+
+	for (int solver = 0; solver < 6; ++solver) {
+		randomGenerator.seed(chainCount);
+
+		GameWorld world;
+		PhysicsSystem physics(world);
+		physics.UseGravity(true);
+		physics.UseBroadPhase(true);
+		physics.UseContiguousConstraints(solver == 1 || solver == 2);
+		physics.UseParallelConstraints(solver == 2);
+		physics.UseXPBD(solver >= 4);
+
+		float linkLength = 3.0f;
+		std::vector<std::pair<GameObject*, GameObject*>> links;
+		for (int c = 0; c < chainCount; ++c) {
+			Vector3 anchor(RandomRange(-500, 500), 400.0f, RandomRange(-500, 500));
+			GameObject* previous = AddBenchObject(world, BenchShape::Sphere, anchor, 0.5f);
+			previous->GetPhysicsObject()->SetInverseMass(0.0f);
+			std::vector<PositionConstraint*> chain;
+			for (int l = 1; l <= linkCount; ++l) {
+				GameObject* link = AddBenchObject(world, BenchShape::Sphere, anchor + Vector3(linkLength * l, 0, 0), 0.5f);
+				chain.emplace_back(new PositionConstraint(previous, link, linkLength));
+				links.emplace_back(previous, link);
+				previous = link;
+			}
+			if (solver == 3 || solver == 5) {
+				world.AddConstraint(ChainConstraint::FromLinks(chain));
+				for (PositionConstraint* c : chain) {
+					delete c;
+				}
+			}
+			else {
+				for (PositionConstraint* c : chain) {
+					world.AddConstraint(c);
+				}
+			}
+		}
+
+		float	constraintMs	= 0.0f;
+		int		stepsTaken		= 0;
+		int		batches			= 0;
+		int		islands			= 0;
+		int		iterations		= 0;
+		while (stepsTaken < steps) {
+			physics.Update(1.0f / 120.0f);
+			constraintMs	+= physics.GetStats().constraintMs;
+			stepsTaken		+= physics.GetStats().steps;
+			batches			= physics.GetStats().constraintBatches;
+			islands			= physics.GetStats().constraintIslands;
+			iterations		= std::max(iterations, physics.GetStats().constraintIterations);
+		}
+		double stretch = 0.0;
+		for (auto& link : links) {
+			float length = (link.first->GetTransform().GetPosition() - link.second->GetTransform().GetPosition()).Length();
+			stretch += std::abs(length - linkLength) / linkLength;
+		}
+		world.ClearAndErase();
+
+		std::cout << chainCount << " chains of " << linkCount << " links, " << solverNames[solver] << ": ";
+		if (solver >= 4) {
+			std::cout << physics.GetSubsteps() << " substeps, ";
+		}
+		else {
+			std::cout << batches << " batches, " << islands << " islands, up to " << iterations << " iterations, ";
+		}
+		std::cout << (constraintMs / stepsTaken) << "ms solving constraints per step, "
+			<< "mean stretch " << (stretch * 100.0 / links.size()) << "%" << std::endl;
+	}
+}
+
+/*
+	Runs the same scene - stacked towers falling under gravity, with a few chains
+	hanging over them - several times in deterministic mode, changing everything
+	that shouldn't matter: whether the constraints are solved in parallel, whether
+	the world was asked to shuffle, and where the objects end up in memory. Every
+	run should record exactly the same hash after every step. Each broadphase
+	structure is checked separately, as they find pairs differently.
+*/
+std::vector<uint64_t> RunDeterministic(int objectCount, int steps, BroadPhaseStructure structure, bool parallel, bool shuffle) {
+	randomGenerator.seed(objectCount);
+
+	GameWorld world;
+	PhysicsSystem physics(world);
+	physics.UseDeterministicMode(true);
+	physics.UseGravity(true);
+	physics.UseBroadPhase(true);
+	physics.SetBroadPhaseStructure(structure);
+	physics.UseParallelConstraints(parallel);
+	world.ShuffleObjects(shuffle);
+	world.ShuffleConstraints(shuffle);
+
+	BuildScene(world, BenchShape::Mixed, BenchLayout::Stacked, objectCount);
+	for (int c = 0; c < 4; ++c) {
+		GameObject* previous = AddBenchObject(world, BenchShape::Sphere, Vector3(c * 10.0f, 40.0f, 0.0f), 0.5f);
+		previous->GetPhysicsObject()->SetInverseMass(0.0f);
+		for (int l = 1; l <= 100; ++l) {
+			GameObject* link = AddBenchObject(world, BenchShape::Sphere, Vector3(c * 10.0f, 40.0f, l * 2.0f), 0.5f);
+			world.AddConstraint(new PositionConstraint(previous, link, 2.0f));
+			previous = link;
+		}
+	}
+
+	std::vector<uint64_t> hashes;
+	while ((int)hashes.size() < steps) {
+		world.UpdateWorld(1.0f / 120.0f);
+		physics.Update(1.0f / 120.0f);
+		hashes.insert(hashes.end(), physics.GetStepHashes().begin(), physics.GetStepHashes().end());
+	}
+	world.ClearAndErase();
+	return hashes;
+}
+
+void BenchmarkDeterminism(int objectCount, int steps, BroadPhaseStructure structure) {
+	std::vector<uint64_t> reference = RunDeterministic(objectCount, steps, structure, false, false);
+
+	for (int run = 1; run < 4; ++run) {
+		// leaves holes all over the heap, so the next run's objects get addresses in a different order
+		std::vector<char*> padding;
+		for (int i = 0; i < 20000; ++i) {
+			padding.emplace_back(new char[16 + (i % 16) * 16]);
+		}
+		std::shuffle(padding.begin(), padding.end(), std::mt19937(run));
+		for (char* p : padding) {
+			delete[] p;
+		}
+		std::vector<uint64_t> hashes = RunDeterministic(objectCount, steps, structure, run != 2, run == 3);
+
+		int mismatch = -1;
+		for (int i = 0; i < steps && mismatch < 0; ++i) {
+			if (hashes[i] != reference[i]) {
+				mismatch = i;
+			}
+		}
+		std::cout << "Deterministic " << (structure == BroadPhaseStructure::Octree ? "octree" : "quadtree") << " run " << run << ": ";
+		if (mismatch < 0) {
+			std::cout << "all " << steps << " step hashes match (" << std::hex << reference[steps - 1] << std::dec << ")" << std::endl;
+		}
+		else {
+			std::cout << "diverged on step " << mismatch << std::endl;
+		}
+	}
+}
+
+/*
+	Times saving and restoring every object's state, and checks that a restored
+	world carries on exactly as it did the first time - in deterministic mode
+	every step after the restore should hash the same as before.
+*/
+void BenchmarkSnapshots(int objectCount, int steps) {
+	randomGenerator.seed(objectCount);
+
+	GameWorld world;
+	PhysicsSystem physics(world);
+	physics.UseDeterministicMode(true);
+	physics.UseGravity(true);
+	physics.UseBroadPhase(true);
+	BuildScene(world, BenchShape::Mixed, BenchLayout::Clustered, objectCount);
+
+	auto run = [&]() {
+		std::vector<uint64_t> hashes;
+		while ((int)hashes.size() < steps) {
+			physics.Update(1.0f / 120.0f);
+			hashes.insert(hashes.end(), physics.GetStepHashes().begin(), physics.GetStepHashes().end());
+		}
+		return hashes;
+	};
+	run(); // get some contacts going first
+
+	std::vector<char> snapshot;
+	physics.SaveState(snapshot);
+	std::vector<uint64_t> before = run();
+	physics.RestoreState(snapshot);
+	std::vector<uint64_t> after = run();
+
+	const int repeats = 100;
+	GameTimer timer;
+	for (int i = 0; i < repeats; ++i) {
+		physics.SaveState(snapshot);
+	}
+	timer.Tick();
+	float saveMs = timer.GetTimeDeltaMSec() / repeats;
+	for (int i = 0; i < repeats; ++i) {
+		physics.RestoreState(snapshot);
+	}
+	timer.Tick();
+	float restoreMs = timer.GetTimeDeltaMSec() / repeats;
+	world.ClearAndErase();
+
+	std::cout << "Snapshot of " << objectCount << " objects: " << snapshot.size() / 1024 << "KB, "
+		<< saveMs << "ms to save, " << restoreMs << "ms to restore, "
+		<< (before == after ? "restored run matches" : "restored run diverged") << std::endl;
+}
+
+/*
+	Times a large scene stepping with every object at full rate, and then again
+	with the physics LOD stepping objects far from the origin less often, and
+	measures how far the LOD moved the objects from where they'd otherwise be.
+*/
+void BenchmarkLOD(int objectCount, int steps) {
+	auto run = [&](bool lod, std::vector<Vector3>& positions, int& reduced) {
+		randomGenerator.seed(objectCount);
+
+		GameWorld world;
+		PhysicsSystem physics(world);
+		physics.UseDeterministicMode(true); // so both runs take the same number of steps
+		physics.UseGravity(true);
+		physics.UseBroadPhase(true);
+		physics.UseLOD(lod);
+		physics.SetLODFocus({ Vector3(0, 0, 0) });
+		BuildScene(world, BenchShape::Mixed, BenchLayout::Random, objectCount);
+
+		float ms = 0.0f;
+		int taken = 0;
+		while (taken < steps) {
+			physics.Update(1.0f / 120.0f);
+			taken	+= physics.GetStats().steps;
+			ms		+= physics.GetStats().totalMs;
+		}
+		reduced = physics.GetStats().reducedRateObjects;
+
+		positions.clear();
+		world.OperateOnContents([&](GameObject* o) {
+			positions.emplace_back(o->GetTransform().GetPosition());
+		});
+		world.ClearAndErase();
+		return ms / taken;
+	};
+
+	std::vector<Vector3> fullPositions;
+	std::vector<Vector3> lodPositions;
+	int reduced = 0;
+	float fullMs	= run(false, fullPositions, reduced);
+	float lodMs		= run(true, lodPositions, reduced);
+
+	// a few objects are flung out of overlaps at huge speeds, so the worst case says little
+	float totalDrift	= 0.0f;
+	int driftCount		= 0;
+	for (size_t i = 0; i < fullPositions.size() && i < lodPositions.size(); ++i) {
+		float drift = (fullPositions[i] - lodPositions[i]).Length();
+		if (drift > 0.0f) {
+			totalDrift += drift;
+			driftCount++;
+		}
+	}
+
+	std::cout << "LOD with " << objectCount << " objects: " << fullMs << "ms per step at full rate, "
+		<< lodMs << "ms with " << reduced << " objects at a reduced rate, "
+		<< driftCount << " objects moved " << (driftCount > 0 ? totalDrift / driftCount : 0.0f) << " apart on average" << std::endl;
+}
+
+/*
+	Times rebuilding every object's matrix after they've all moved, on one
+	thread and then split over the physics system's workers.
+*/
+void BenchmarkTransforms(int objectCount, int repeats) {
+	randomGenerator.seed(objectCount);
+
+	GameWorld world;
+	PhysicsSystem physics(world);
+	BuildScene(world, BenchShape::Mixed, BenchLayout::Random, objectCount);
+
+	auto time = [&](WorkerPool* workers) {
+		float ms = 0.0f;
+		for (int r = 0; r < repeats; ++r) {
+			world.OperateOnContents([&](GameObject* o) {
+				Transform& t = o->GetTransform();
+				t.SetPosition(t.GetPosition() + Vector3(0, 0.01f, 0));
+			});
+			GameTimer timer;
+			world.UpdateTransforms(workers);
+			timer.Tick();
+			ms += timer.GetTimeDeltaMSec();
+		}
+		return ms / repeats;
+	};
+	float serialMs		= time(nullptr);
+	float parallelMs	= time(physics.GetWorkerPool());
+	world.ClearAndErase();
+
+	std::cout << "Transforms for " << objectCount << " objects: " << serialMs << "ms on one thread, "
+		<< parallelMs << "ms on " << physics.GetWorkerPool()->GetThreadCount() << " threads" << std::endl;
+}
+
+/*
+	Builds chains of child transforms and moves only a tenth of their roots each
+	frame, to check that the rest cost nothing, and that a chain's last link
+	ends up where multiplying out all of its parents says it should.
+*/
+void BenchmarkHierarchy(int chainCount, int chainLength, int repeats) {
+	GameWorld world;
+	std::vector<GameObject*> roots;
+	for (int i = 0; i < chainCount; ++i) {
+		Transform* parent = nullptr;
+		for (int j = 0; j < chainLength; ++j) {
+			GameObject* link = new GameObject("link");
+			link->GetTransform()
+				.SetPosition(parent ? Vector3(0, -2, 0) : Vector3((float)i, 0, 0))
+				.SetOrientation(Quaternion::AxisAngleToQuaterion(Vector3(0, 0, 1), 5.0f));
+			link->GetTransform().SetParent(parent);
+			parent = &link->GetTransform();
+			world.AddGameObject(link);
+			if (j == 0) {
+				roots.emplace_back(link);
+			}
+		}
+	}
+	world.UpdateTransforms();
+
+	float ms = 0.0f;
+	for (int r = 0; r < repeats; ++r) {
+		for (int i = r % 10; i < chainCount; i += 10) {
+			Transform& t = roots[i]->GetTransform();
+			t.SetPosition(t.GetPosition() + Vector3(0, 0.01f, 0));
+		}
+		GameTimer timer;
+		world.UpdateTransforms();
+		timer.Tick();
+		ms += timer.GetTimeDeltaMSec();
+	}
+
+	float error = 0.0f;
+	for (GameObject* root : roots) {
+		const Transform* t = &root->GetTransform();
+		Matrix4 expected = t->GetMatrix();
+		while (!t->GetChildren().empty()) {
+			t = t->GetChildren()[0];
+			expected = expected * Matrix4::Translation(t->GetPosition()) * Matrix4(t->GetOrientation());
+		}
+		Vector3 offset = expected.GetPositionVector() - t->GetMatrix().GetPositionVector();
+		error = std::max(error, offset.Length());
+	}
+	world.ClearAndErase();
+
+	std::cout << "Hierarchy of " << chainCount << " chains of " << chainLength << ", a tenth moving: "
+		<< ms / repeats << "ms (error " << error << ")" << std::endl;
+}
+
+/*
+	Fires rays through a scene of every shape, half of them aimed at an object
+	and half in any direction, one at a time and then four at a time, and
+	counts the rays that the two disagree about.
+*/
+void BenchmarkRaycasts(int objectCount, int rayCount) {
+	randomGenerator.seed(objectCount);
+
+	GameWorld world;
+	BuildScene(world, BenchShape::Mixed, BenchLayout::Clustered, objectCount);
+
+	std::vector<GameObject*> objects;
+	world.OperateOnContents([&](GameObject* o) { objects.emplace_back(o); });
+
+	std::vector<Ray> rays;
+	for (int i = 0; i < rayCount; ++i) {
+		Vector3 origin(RandomRange(-100, 100), RandomRange(0, 100), RandomRange(-100, 100));
+		Vector3 direction = (i % 2) ? Vector3(RandomNormal(1), RandomNormal(1), RandomNormal(1))
+			: objects[i % objects.size()]->GetTransform().GetPosition() - origin;
+		rays.emplace_back(origin, direction.Normalised());
+	}
+
+	std::vector<RayCollision> single(rayCount);
+	GameTimer singleTimer;
+	for (int i = 0; i < rayCount; ++i) {
+		world.Raycast(rays[i], single[i], true);
+	}
+	singleTimer.Tick();
+
+	std::vector<RayCollision> packets(rayCount);
+	GameTimer packetTimer;
+	for (int i = 0; i + 3 < rayCount; i += 4) {
+		world.Raycast(RayPacket(rays[i], rays[i + 1], rays[i + 2], rays[i + 3]), &packets[i]);
+	}
+	packetTimer.Tick();
+
+	int hits		= 0;
+	int mismatches	= 0;
+	for (int i = 0; i < rayCount / 4 * 4; ++i) {
+		hits += single[i].node ? 1 : 0;
+		if (single[i].node != packets[i].node ||
+			(single[i].node && std::abs(single[i].rayDistance - packets[i].rayDistance) > 1e-3f)) {
+			mismatches++;
+		}
+	}
+	world.ClearAndErase();
+
+	std::cout << "Raycasts against " << objectCount << " objects: " << rayCount << " rays, " << hits << " hits, "
+		<< singleTimer.GetTimeDeltaMSec() << "ms one at a time, " << packetTimer.GetTimeDeltaMSec()
+		<< "ms four at a time, " << mismatches << " mismatches" << std::endl;
+}
+
+void WriteCSV(const std::string& filename, const std::vector<BenchResult>& results) {
+	std::ofstream file(filename);
+	file << "shape,layout,mode,objects,steps,pairs,contacts,integrate_ms,broadphase_ms,narrowphase_ms,constraint_ms\n";
+	for (const BenchResult& r : results) {
+		file << r.shape << "," << r.layout << "," << r.mode << "," << r.objects << ","
+			<< r.perStep.steps << "," << r.perStep.broadphasePairs << "," << r.perStep.contacts << ","
+			<< r.perStep.integrateMs << "," << r.perStep.broadphaseMs << ","
+			<< r.perStep.narrowphaseMs << "," << r.perStep.constraintMs << "\n";
+	}
+}
+
+void WriteJSON(const std::string& filename, const std::vector<BenchResult>& results) {
+	std::ofstream file(filename);
+	file << "[\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& r = results[i];
+		file << "\t{ \"shape\": \"" << r.shape << "\", \"layout\": \"" << r.layout << "\", \"mode\": \"" << r.mode << "\""
+			<< ", \"objects\": " << r.objects << ", \"steps\": " << r.perStep.steps
+			<< ", \"pairs\": " << r.perStep.broadphasePairs << ", \"contacts\": " << r.perStep.contacts
+			<< ", \"integrate_ms\": " << r.perStep.integrateMs << ", \"broadphase_ms\": " << r.perStep.broadphaseMs
+			<< ", \"narrowphase_ms\": " << r.perStep.narrowphaseMs << ", \"constraint_ms\": " << r.perStep.constraintMs
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "]\n";
+}
+
+/*
+	Usage: PhysicsBenchmark [-max objects] [-steps count] [-out filename]
+	Writes every result to filename.csv and filename.json. Brute force is
+	skipped above 10,000 objects, as it would take hours.
+*/
+int main(int argc, char** argv) {
+	int			maxObjects	= 100000;
+	int			steps		= 5;
+	std::string outName		= "PhysicsBenchmark";
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		if (arg == "-max") {
+			maxObjects = atoi(argv[i + 1]);
+		}
+		else if (arg == "-steps") {
+			steps = std::max(1, atoi(argv[i + 1]));
+		}
+		else if (arg == "-out") {
+			outName = argv[i + 1];
+		}
+	}
+
+	BenchmarkQuadTreeAllocations(5000, 120);
+	BenchmarkConstraints(20, 500, 60);
+	BenchmarkDeterminism(2000, 240, BroadPhaseStructure::QuadTree);
+	BenchmarkDeterminism(2000, 240, BroadPhaseStructure::Octree);
+	BenchmarkSnapshots(10000, 60);
+	BenchmarkLOD(20000, 120);
+	BenchmarkTransforms(100000, 20);
+	BenchmarkHierarchy(10000, 8, 20);
+	BenchmarkRaycasts(10000, 4000);
+
+	const int bruteForceLimit = 10000;
+	std::vector<BenchResult> results;
+
+	for (int objects = 100; objects <= maxObjects; objects *= 10) {
+		for (int layout = 0; layout < 3; ++layout) {
+			for (int shape = 0; shape < 5; ++shape) {
+				for (int mode = 0; mode < 3; ++mode) {
+					if ((BenchMode)mode == BenchMode::BruteForce && objects > bruteForceLimit) {
+						continue;
+					}
+					BenchResult r = RunBenchmark((BenchShape)shape, (BenchLayout)layout, (BenchMode)mode, objects, steps);
+					std::cout << r.objects << " " << r.layout << " " << r.shape << " " << r.mode
+						<< ": " << r.perStep.broadphasePairs << " pairs, " << r.perStep.contacts << " contacts, "
+						<< (r.perStep.broadphaseMs + r.perStep.narrowphaseMs) << "ms collision detection per step" << std::endl;
+					results.push_back(r);
+				}
+			}
+		}
+	}
+	WriteCSV(outName + ".csv", results);
+	WriteJSON(outName + ".json", results);
+	std::cout << "Wrote " << results.size() << " results to " << outName << ".csv and " << outName << ".json" << std::endl;
+	return 0;
+}
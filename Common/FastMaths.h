@@ -0,0 +1,120 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "SIMD.h"
+#include <cmath>
+#include <cfloat>
+
+#if defined(NCL_SSE) && (defined(__FMA__) || defined(__AVX2__))
+	#define NCL_FMA
+	#include <immintrin.h>
+#endif
+
+/*
+	The few operations the physics does so often that their accuracy is worth
+	trading for speed. Which version gets used is picked when compiling -
+	defining NCL_FAST_MATHS switches the defaults over to the approximate ones -
+	but either can always be asked for by name, so that (say) a test can
+	compare the two, or something that needs exact results can keep them.
+*/
+namespace NCL {
+	namespace Maths {
+		// Exactly what the maths classes have always done
+		struct PreciseMaths {
+			static float InvSqrt(float f) {
+				return 1.0f / std::sqrt(f);
+			}
+
+			static SIMD::Float4 InvSqrt(SIMD::Float4 f) {
+				return SIMD::Div(SIMD::Splat(1.0f), SIMD::Sqrt(f));
+			}
+
+			static float MulAdd(float a, float b, float c) {
+				return a * b + c;
+			}
+		};
+
+		/*
+			The hardware's reciprocal square root estimate, sharpened with a Newton
+			step to within a few parts in ten million of the precise one, and a fused
+			multiply-add on CPUs built for it, which rounds once instead of twice.
+
+			The estimate is only used 4 lanes at a time. On one float, moving it in and
+			out of a vector register, and checking for the inputs the estimate can't
+			handle, cost more than the divide it saves, so that stays precise. Recent
+			x64 CPUs divide and take square roots quickly enough that the precise
+			version wins 4 wide as well - the estimate pays where those are slow.
+		*/
+		struct FastMaths {
+			static float InvSqrt(float f) {
+				return PreciseMaths::InvSqrt(f);
+			}
+
+			/*
+				No branches - lanes below FLT_MIN are scaled up by 2^24 first, as the
+				estimate can't cope with denormals, and their results by 2^12 after.
+				Lanes the Newton step turns into NaN (zero, infinity, NaN and negatives)
+				keep the raw estimate, which is already the right answer for all of them.
+			*/
+			static SIMD::Float4 InvSqrt(SIMD::Float4 f) {
+#if defined(NCL_SSE) || defined(NCL_NEON)
+				SIMD::Float4 one	= SIMD::Splat(1.0f);
+				SIMD::Float4 tiny	= SIMD::Less(f, SIMD::Splat(FLT_MIN));
+				SIMD::Float4 v		= SIMD::Mul(f, SIMD::Select(tiny, SIMD::Splat(16777216.0f), one));
+#if defined(NCL_SSE)
+				SIMD::Float4 e		= _mm_rsqrt_ps(v);
+				SIMD::Float4 r		= SIMD::Mul(e, SIMD::Sub(SIMD::Splat(1.5f), SIMD::Mul(SIMD::Mul(SIMD::Splat(0.5f), v), SIMD::Mul(e, e))));
+#else
+				SIMD::Float4 e		= vrsqrteq_f32(v);
+				SIMD::Float4 r		= vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+				r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+#endif
+				r = SIMD::Select(SIMD::Equal(r, r), r, e);
+				return SIMD::Mul(r, SIMD::Select(tiny, SIMD::Splat(4096.0f), one));
+#else
+				return PreciseMaths::InvSqrt(f);
+#endif
+			}
+
+			static float MulAdd(float a, float b, float c) {
+#if defined(NCL_FMA)
+				return _mm_cvtss_f32(_mm_fmadd_ss(_mm_set_ss(a), _mm_set_ss(b), _mm_set_ss(c)));
+#elif defined(NCL_NEON)
+				return vget_lane_f32(vfma_f32(vdup_n_f32(c), vdup_n_f32(a), vdup_n_f32(b)), 0);
+#else
+				return a * b + c;
+#endif
+			}
+		};
+
+#if defined(NCL_FAST_MATHS)
+		typedef FastMaths	DefaultMaths;
+#else
+		typedef PreciseMaths DefaultMaths;
+#endif
+
+		// 1 / sqrt(f)
+		template <class Policy = DefaultMaths>
+		inline float InvSqrt(float f) {
+			return Policy::InvSqrt(f);
+		}
+
+		// ...in each lane
+		template <class Policy = DefaultMaths>
+		inline SIMD::Float4 InvSqrt(SIMD::Float4 f) {
+			return Policy::InvSqrt(f);
+		}
+
+		// a * b + c
+		template <class Policy = DefaultMaths>
+		inline float MulAdd(float a, float b, float c) {
+			return Policy::MulAdd(a, b, c);
+		}
+	}
+}
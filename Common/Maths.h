@@ -41,6 +41,11 @@ namespace NCL {
 			return value;
 		}
 
+		// Compiles down to a min and a max, with no branches to mispredict
+		inline float Clamp(float value, float min, float max) {
+			return std::min(std::max(value, min), max);
+		}
+
 		Vector3 Clamp(const Vector3& a, const Vector3&mins, const Vector3& maxs);
 
 		template<class T>
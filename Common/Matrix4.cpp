@@ -281,6 +281,34 @@ Matrix4 Matrix4::Inverse()	const {
 	return temp;
 }
 
+Matrix4 Matrix4::AffineInverse() const {
+	//aRC is row R, column C of the 3x3 part
+	float a00 = array[0], a10 = array[1], a20 = array[2];
+	float a01 = array[4], a11 = array[5], a21 = array[6];
+	float a02 = array[8], a12 = array[9], a22 = array[10];
+
+	float c00 = a11 * a22 - a12 * a21;
+	float c01 = a12 * a20 - a10 * a22;
+	float c02 = a10 * a21 - a11 * a20;
+
+	float invDet = 1.0f / (a00 * c00 + a01 * c01 + a02 * c02);
+
+	Matrix4 out;
+	out.array[0]	= c00 * invDet;
+	out.array[1]	= c01 * invDet;
+	out.array[2]	= c02 * invDet;
+	out.array[4]	= (a02 * a21 - a01 * a22) * invDet;
+	out.array[5]	= (a00 * a22 - a02 * a20) * invDet;
+	out.array[6]	= (a01 * a20 - a00 * a21) * invDet;
+	out.array[8]	= (a01 * a12 - a02 * a11) * invDet;
+	out.array[9]	= (a02 * a10 - a00 * a12) * invDet;
+	out.array[10]	= (a00 * a11 - a01 * a10) * invDet;
+
+	Vector3 translation = out.TransformDirection(GetPositionVector());
+	out.SetPositionVector(-translation);
+	return out;
+}
+
 Vector4 Matrix4::GetRow(unsigned int row) const {
 	Vector4 out(0, 0, 0, 1);
 	if (row <= 3) {
@@ -323,10 +351,42 @@ Vector3 Matrix4::operator*(const Vector3 &v) const {
 }
 
 Vector4 Matrix4::operator*(const Vector4 &v) const {
-	return Vector4(
+	Vector4 out;
+#if defined(NCL_SSE)
+	__m128 result = _mm_mul_ps(_mm_loadu_ps(array), _mm_set1_ps(v.x));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(array + 4), _mm_set1_ps(v.y)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(array + 8), _mm_set1_ps(v.z)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(array + 12), _mm_set1_ps(v.w)));
+	_mm_storeu_ps(out.array, result);
+#elif defined(NCL_NEON)
+	float32x4_t result = vmulq_n_f32(vld1q_f32(array), v.x);
+	result = vmlaq_n_f32(result, vld1q_f32(array + 4), v.y);
+	result = vmlaq_n_f32(result, vld1q_f32(array + 8), v.z);
+	result = vmlaq_n_f32(result, vld1q_f32(array + 12), v.w);
+	vst1q_f32(out.array, result);
+#else
+	out = Vector4(
 		v.x*array[0] + v.y*array[4] + v.z*array[8] + v.w * array[12],
 		v.x*array[1] + v.y*array[5] + v.z*array[9] + v.w * array[13],
 		v.x*array[2] + v.y*array[6] + v.z*array[10] + v.w * array[14],
 		v.x*array[3] + v.y*array[7] + v.z*array[11] + v.w * array[15]
 	);
+#endif
+	return out;
+}
+
+Vector3 Matrix4::TransformPoint(const Vector3& v) const {
+	return Vector3(
+		v.x*array[0] + v.y*array[4] + v.z*array[8] + array[12],
+		v.x*array[1] + v.y*array[5] + v.z*array[9] + array[13],
+		v.x*array[2] + v.y*array[6] + v.z*array[10] + array[14]
+	);
+}
+
+Vector3 Matrix4::TransformDirection(const Vector3& v) const {
+	return Vector3(
+		v.x*array[0] + v.y*array[4] + v.z*array[8],
+		v.x*array[1] + v.y*array[5] + v.z*array[9],
+		v.x*array[2] + v.y*array[6] + v.z*array[10]
+	);
 }
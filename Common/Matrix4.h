@@ -9,6 +9,7 @@ https://research.ncl.ac.uk/game/
 #pragma once
 
 #include <iostream>
+#include "SIMD.h"
 
 namespace NCL {
 	namespace Maths {
@@ -17,6 +18,12 @@ namespace NCL {
 		class Matrix3;
 		class Quaternion;
 
+		/*
+			Deliberately not alignas(16) - Transforms and GameObjects hold one, and
+			they're allocated with plain new, which on 32-bit builds only promises 8.
+			The columns are read with unaligned loads (see SIMD.h), which cost
+			nothing extra when the matrix happens to be aligned anyway.
+		*/
 		class Matrix4 {
 		public:
 			Matrix4(void);
@@ -69,28 +76,67 @@ namespace NCL {
 			void    Invert();
 			Matrix4 Inverse() const;
 
+			//Only for matrices that don't project (bottom row 0,0,0,1) - inverts
+			//the 3x3 part, and runs the translation back through it. Much less
+			//work than Inverse, which has to handle any 4x4 matrix
+			Matrix4 AffineInverse() const;
+
 
 			Vector4 GetRow(unsigned int row) const;
 			Vector4 GetColumn(unsigned int column) const;
 
 			//Multiplies 'this' matrix by matrix 'a'. Performs the multiplication in 'OpenGL' order (ie, backwards)
+			//Each column of the result is the columns of 'this', weighted by the matching column of 'a'
 			inline Matrix4 operator*(const Matrix4& a) const {
 				Matrix4 out;
-				//Students! You should be able to think up a really easy way of speeding this up...
+#if defined(NCL_SSE)
+				__m128 c0 = _mm_loadu_ps(array);
+				__m128 c1 = _mm_loadu_ps(array + 4);
+				__m128 c2 = _mm_loadu_ps(array + 8);
+				__m128 c3 = _mm_loadu_ps(array + 12);
+				for (unsigned int r = 0; r < 4; ++r) {
+					const float* col = a.array + (r * 4);
+					__m128 result = _mm_mul_ps(c0, _mm_set1_ps(col[0]));
+					result = _mm_add_ps(result, _mm_mul_ps(c1, _mm_set1_ps(col[1])));
+					result = _mm_add_ps(result, _mm_mul_ps(c2, _mm_set1_ps(col[2])));
+					result = _mm_add_ps(result, _mm_mul_ps(c3, _mm_set1_ps(col[3])));
+					_mm_storeu_ps(out.array + (r * 4), result);
+				}
+#elif defined(NCL_NEON)
+				float32x4_t c0 = vld1q_f32(array);
+				float32x4_t c1 = vld1q_f32(array + 4);
+				float32x4_t c2 = vld1q_f32(array + 8);
+				float32x4_t c3 = vld1q_f32(array + 12);
 				for (unsigned int r = 0; r < 4; ++r) {
+					const float* col = a.array + (r * 4);
+					float32x4_t result = vmulq_n_f32(c0, col[0]);
+					result = vmlaq_n_f32(result, c1, col[1]);
+					result = vmlaq_n_f32(result, c2, col[2]);
+					result = vmlaq_n_f32(result, c3, col[3]);
+					vst1q_f32(out.array + (r * 4), result);
+				}
+#else
+				for (unsigned int r = 0; r < 4; ++r) {
+					const float* col = a.array + (r * 4);
 					for (unsigned int c = 0; c < 4; ++c) {
-						out.array[c + (r * 4)] = 0.0f;
-						for (unsigned int i = 0; i < 4; ++i) {
-							out.array[c + (r * 4)] += this->array[c + (i * 4)] * a.array[(r * 4) + i];
-						}
+						out.array[c + (r * 4)] = array[c] * col[0] + array[c + 4] * col[1] + array[c + 8] * col[2] + array[c + 12] * col[3];
 					}
 				}
+#endif
 				return out;
 			}
 
+			//Transforms 'v' as a point, with a w of 1, and divides the result by its w -
+			//only needed for projections, everything else should use TransformPoint
 			Vector3 operator*(const Vector3& v) const;
 			Vector4 operator*(const Vector4& v) const;
 
+			//For matrices that don't project (bottom row 0,0,0,1) - the same as
+			//operator*(Vector3), without the divide
+			Vector3 TransformPoint(const Vector3& v) const;
+			//Rotates and scales 'v', ignoring the translation
+			Vector3 TransformDirection(const Vector3& v) const;
+
 			//Handy string output for the matrix. Can get a bit messy, but better than nothing!
 			inline friend std::ostream& operator<<(std::ostream& o, const Matrix4& m) {
 				o << "Mat4(";
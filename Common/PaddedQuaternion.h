@@ -0,0 +1,80 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "PaddedVector3.h"
+#include "Quaternion.h"
+
+namespace NCL {
+	namespace Maths {
+		/*
+			A Quaternion kept in a SIMD register, to go with PaddedVector3 in hot
+			loops. Multiplying two together is four multiplies of b by a single
+			element of a, with b's elements shuffled and sign flipped to line up.
+		*/
+		class alignas(16) PaddedQuaternion {
+		public:
+			PaddedQuaternion() : data(SIMD::Set(0.0f, 0.0f, 0.0f, 1.0f)) {}
+			PaddedQuaternion(float x, float y, float z, float w) : data(SIMD::Set(x, y, z, w)) {}
+			explicit PaddedQuaternion(const Quaternion& q) : data(SIMD::Load(q.array)) {}
+			// A pure quaternion for v, with w added on
+			PaddedQuaternion(const PaddedVector3& v, float w) : data(SIMD::Add(v.GetData(), SIMD::Set(0.0f, 0.0f, 0.0f, w))) {}
+			explicit PaddedQuaternion(SIMD::Float4 f) : data(f) {}
+
+			Quaternion ToQuaternion() const {
+				Quaternion out;
+				SIMD::Store(out.array, data);
+				return out;
+			}
+
+			SIMD::Float4 GetData() const {
+				return data;
+			}
+
+			PaddedQuaternion Conjugate() const {
+				return PaddedQuaternion(SIMD::Mul(data, SIMD::Set(-1.0f, -1.0f, -1.0f, 1.0f)));
+			}
+
+			PaddedQuaternion Normalised() const {
+				float magnitudeSquared = SIMD::Dot4(data, data);
+				return (magnitudeSquared > 0.0f) ? PaddedQuaternion(SIMD::Mul(data, SIMD::Splat(InvSqrt(magnitudeSquared)))) : *this;
+			}
+
+			// The same product as Quaternion::operator*
+			inline PaddedQuaternion operator*(const PaddedQuaternion& b) const {
+				SIMD::Float4 out = SIMD::Mul(SIMD::SplatLane<3>(data), b.data);
+				out = SIMD::MulAdd(SIMD::SplatLane<0>(data), SIMD::Mul(SIMD::WZYX(b.data), SIMD::Set(1.0f, -1.0f, 1.0f, -1.0f)), out);
+				out = SIMD::MulAdd(SIMD::SplatLane<1>(data), SIMD::Mul(SIMD::ZWXY(b.data), SIMD::Set(1.0f, 1.0f, -1.0f, -1.0f)), out);
+				out = SIMD::MulAdd(SIMD::SplatLane<2>(data), SIMD::Mul(SIMD::YXWZ(b.data), SIMD::Set(-1.0f, 1.0f, 1.0f, -1.0f)), out);
+				return PaddedQuaternion(out);
+			}
+
+			/*
+				Rotates v by this (unit) quaternion, the same as q * v * q', but without
+				either quaternion product: v + w * t + (q x t), where t = 2 * (q x v)
+			*/
+			inline PaddedVector3 operator*(const PaddedVector3& v) const {
+				SIMD::Float4 t = SIMD::Cross3(data, v.GetData());
+				t = SIMD::Add(t, t);
+				SIMD::Float4 out = SIMD::MulAdd(SIMD::SplatLane<3>(data), t, v.GetData());
+				return PaddedVector3(SIMD::Add(out, SIMD::Cross3(data, t)));
+			}
+
+			inline PaddedQuaternion operator+(const PaddedQuaternion& a) const {
+				return PaddedQuaternion(SIMD::Add(data, a.data));
+			}
+
+			inline PaddedQuaternion operator*(float a) const {
+				return PaddedQuaternion(SIMD::Mul(data, SIMD::Splat(a)));
+			}
+
+		protected:
+			SIMD::Float4 data;
+		};
+	}
+}
@@ -0,0 +1,109 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "SIMD.h"
+#include "Vector3.h"
+
+namespace NCL {
+	namespace Maths {
+		/*
+			A Vector3 padded out to four floats, so that it fits a whole SIMD register
+			and every operation works on all of it at once. It's only meant for hot
+			loops - load Vector3s into it, do the maths, and store the result back -
+			as it takes up a third more memory, and the padding is wasted in anything
+			that's stored for long. The padding (w) is kept at 0.
+		*/
+		class alignas(16) PaddedVector3 {
+		public:
+			PaddedVector3() : data(SIMD::Splat(0.0f)) {}
+			PaddedVector3(float x, float y, float z) : data(SIMD::Set(x, y, z, 0.0f)) {}
+			explicit PaddedVector3(const Vector3& v) : data(SIMD::Set(v.x, v.y, v.z, 0.0f)) {}
+			explicit PaddedVector3(SIMD::Float4 f) : data(f) {}
+
+			// Reads x, y and z from three packed floats
+			static PaddedVector3 Load(const float* f) {
+				return PaddedVector3(f[0], f[1], f[2]);
+			}
+			// Writes x, y and z out as three packed floats
+			void Store(float* f) const {
+				alignas(16) float out[4];
+				SIMD::Store(out, data);
+				f[0] = out[0];
+				f[1] = out[1];
+				f[2] = out[2];
+			}
+
+			Vector3 ToVector3() const {
+				Vector3 out;
+				Store(out.array);
+				return out;
+			}
+
+			SIMD::Float4 GetData() const {
+				return data;
+			}
+
+			static float Dot(const PaddedVector3& a, const PaddedVector3& b) {
+				return SIMD::Dot3(a.data, b.data);
+			}
+
+			static PaddedVector3 Cross(const PaddedVector3& a, const PaddedVector3& b) {
+				return PaddedVector3(SIMD::Cross3(a.data, b.data));
+			}
+
+			float LengthSquared() const {
+				return SIMD::Dot3(data, data);
+			}
+
+			float Length() const {
+				return sqrt(LengthSquared());
+			}
+
+			PaddedVector3 Normalised() const {
+				float lengthSquared = SIMD::Dot3(data, data);
+				return (lengthSquared != 0.0f) ? *this * InvSqrt(lengthSquared) : *this;
+			}
+
+			inline PaddedVector3 operator+(const PaddedVector3& a) const {
+				return PaddedVector3(SIMD::Add(data, a.data));
+			}
+
+			inline PaddedVector3 operator-(const PaddedVector3& a) const {
+				return PaddedVector3(SIMD::Sub(data, a.data));
+			}
+
+			inline PaddedVector3 operator-() const {
+				return PaddedVector3(SIMD::Sub(SIMD::Splat(0.0f), data));
+			}
+
+			inline PaddedVector3 operator*(float a) const {
+				return PaddedVector3(SIMD::Mul(data, SIMD::Splat(a)));
+			}
+
+			inline PaddedVector3 operator*(const PaddedVector3& a) const {
+				return PaddedVector3(SIMD::Mul(data, a.data));
+			}
+
+			inline void operator+=(const PaddedVector3& a) {
+				data = SIMD::Add(data, a.data);
+			}
+
+			inline void operator-=(const PaddedVector3& a) {
+				data = SIMD::Sub(data, a.data);
+			}
+
+			inline void operator*=(float a) {
+				data = SIMD::Mul(data, SIMD::Splat(a));
+			}
+
+		protected:
+			SIMD::Float4 data;
+		};
+	}
+}
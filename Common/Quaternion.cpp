@@ -11,6 +11,7 @@ https://research.ncl.ac.uk/game/
 #include "Matrix3.h"
 #include "Vector3.h"
 #include "Maths.h"
+#include "FastMaths.h"
 #include <algorithm>
 #include <cmath>
 
@@ -80,10 +81,10 @@ float Quaternion::Dot(const Quaternion &a,const Quaternion &b){
 }
 
 void Quaternion::Normalise(){
-	float magnitude = sqrt(x*x + y*y + z*z + w*w);
+	float magnitudeSquared = x*x + y*y + z*z + w*w;
 
-	if(magnitude > 0.0f){
-		float t = 1.0f / magnitude;
+	if(magnitudeSquared > 0.0f){
+		float t = InvSqrt(magnitudeSquared);
 
 		x *= t;
 		y *= t;
@@ -193,7 +194,9 @@ Quaternion Quaternion::AxisAngleToQuaterion(const Vector3& vector, float degrees
 }
 
 
+//The same as *this * a * Conjugate(), without either quaternion product
 Vector3		Quaternion::operator *(const Vector3 &a)	const {
-	Quaternion newVec = *this * Quaternion(a.x, a.y, a.z, 0.0f) * Conjugate();
-	return Vector3(newVec.x, newVec.y, newVec.z);
+	Vector3 q(x, y, z);
+	Vector3 t = Vector3::Cross(q, a) * 2.0f;
+	return a + (t * w) + Vector3::Cross(q, t);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#include "RigidTransform.h"
+#include "Matrix4.h"
+#include "Quaternion.h"
+
+using namespace NCL;
+using namespace NCL::Maths;
+
+RigidTransform::RigidTransform() : scale(1, 1, 1) {
+}
+
+RigidTransform::RigidTransform(const Vector3& position, const Quaternion& orientation, const Vector3& scale)
+	: rotation(orientation), position(position), scale(scale) {
+}
+
+RigidTransform::RigidTransform(const Vector3& position, const Matrix3& rotation, const Vector3& scale)
+	: rotation(rotation), position(position), scale(scale) {
+}
+
+RigidTransform RigidTransform::Inverse() const {
+	Vector3 inverseScale = Vector3(1, 1, 1) / scale;
+	return RigidTransform(InverseTransformPoint(Vector3(0, 0, 0)), rotation.Transposed(), inverseScale);
+}
+
+RigidTransform RigidTransform::operator*(const RigidTransform& b) const {
+	// a uniform scale can be moved past the rotation, so the result is still a scale then a rotation
+	return RigidTransform(TransformPoint(b.position), rotation * b.rotation, scale * b.scale);
+}
+
+Matrix4 RigidTransform::ToMatrix4() const {
+	Matrix4 m(rotation);
+	for (int i = 0; i < 3; ++i) {
+		m.array[i]		*= scale.x;
+		m.array[i + 4]	*= scale.y;
+		m.array[i + 8]	*= scale.z;
+	}
+	m.SetPositionVector(position);
+	return m;
+}
@@ -0,0 +1,78 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+#include "Matrix3.h"
+#include "Vector3.h"
+
+namespace NCL {
+	namespace Maths {
+		class Matrix4;
+		class Quaternion;
+
+		/*
+			A scale, then a rotation, then a translation - what nearly every object
+			and camera in the engine is. Kept in pieces rather than as a Matrix4, so
+			that undoing it is a transpose and a divide rather than a full 4x4
+			inversion, and applying it skips the bottom row.
+
+			The scale is per axis, but the inverse of a non-uniformly scaled rotation
+			is scaled after it's rotated, which this can't store - so Inverse() and
+			composing onto something scaled are only exact for uniform scales. The
+			InverseTransform functions are always exact.
+		*/
+		class RigidTransform {
+		public:
+			RigidTransform();
+			RigidTransform(const Vector3& position, const Quaternion& orientation, const Vector3& scale = Vector3(1, 1, 1));
+			RigidTransform(const Vector3& position, const Matrix3& rotation, const Vector3& scale = Vector3(1, 1, 1));
+			~RigidTransform() {}
+
+			Vector3 TransformPoint(const Vector3& p) const {
+				return TransformDirection(p) + position;
+			}
+			Vector3 TransformDirection(const Vector3& d) const {
+				return rotation * (d * scale);
+			}
+			// Local space from world space - the rotation's transpose is its inverse
+			Vector3 InverseTransformPoint(const Vector3& p) const {
+				return InverseTransformDirection(p - position);
+			}
+			Vector3 InverseTransformDirection(const Vector3& d) const {
+				const float* m = rotation.array;
+				return Vector3(
+					m[0] * d.x + m[1] * d.y + m[2] * d.z,
+					m[3] * d.x + m[4] * d.y + m[5] * d.z,
+					m[6] * d.x + m[7] * d.y + m[8] * d.z
+				) / scale;
+			}
+
+			RigidTransform Inverse() const;
+
+			// Applies b first, then this
+			RigidTransform operator*(const RigidTransform& b) const;
+
+			Matrix4 ToMatrix4() const;
+
+			Vector3 GetPosition() const {
+				return position;
+			}
+			const Matrix3& GetRotation() const {
+				return rotation;
+			}
+			Vector3 GetScale() const {
+				return scale;
+			}
+
+		protected:
+			Matrix3 rotation;
+			Vector3 position;
+			Vector3 scale;
+		};
+	}
+}
@@ -0,0 +1,356 @@
+/*
+Part of Newcastle University's Game Engineering source code.
+
+Use as you see fit!
+
+Comments and queries to: richard-gordon.davison AT ncl.ac.uk
+https://research.ncl.ac.uk/game/
+*/
+#pragma once
+
+/*
+	Picks the vector instructions the maths classes use. Every x64 (and PS4) CPU
+	has SSE, and every 64-bit ARM one has NEON - anything else, or defining
+	NCL_NO_SIMD, gets the plain scalar code instead.
+
+	Only unaligned loads and stores are used, so nothing breaks if a matrix ends
+	up somewhere that isn't 16-byte aligned - a 32-bit heap, or a buffer from a
+	custom allocator. On anything recent they cost the same as aligned ones when
+	the data is aligned anyway.
+
+	Comparisons return a mask with every bit of a lane set where the comparison
+	was true, ready to be passed to Select or Mask.
+*/
+#if defined(NCL_NO_SIMD)
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define NCL_SSE
+	#include <xmmintrin.h>
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+	#define NCL_NEON
+	#include <arm_neon.h>
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace NCL {
+	namespace Maths {
+		/*
+			The handful of 4-wide operations the padded vector and quaternion types
+			are built from, so that they only have to be written once.
+		*/
+		namespace SIMD {
+#if defined(NCL_SSE)
+			typedef __m128 Float4;
+
+			inline Float4 Set(float x, float y, float z, float w) {
+				return _mm_set_ps(w, z, y, x);
+			}
+			inline Float4 Splat(float f) {
+				return _mm_set1_ps(f);
+			}
+			inline Float4 Load(const float* f) {
+				return _mm_loadu_ps(f);
+			}
+			inline void Store(float* f, Float4 a) {
+				_mm_storeu_ps(f, a);
+			}
+			inline Float4 Add(Float4 a, Float4 b) {
+				return _mm_add_ps(a, b);
+			}
+			inline Float4 Sub(Float4 a, Float4 b) {
+				return _mm_sub_ps(a, b);
+			}
+			inline Float4 Mul(Float4 a, Float4 b) {
+				return _mm_mul_ps(a, b);
+			}
+			// Copies lane i (0 is x) to every lane
+			template <int i> inline Float4 SplatLane(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(i, i, i, i));
+			}
+			// Reorders the lanes - (x,y,z,w) becomes (y,z,x,w), (z,x,y,w), and so on
+			inline Float4 YZXW(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+			}
+			inline Float4 ZXYW(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+			}
+			inline Float4 WZYX(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 1, 2, 3));
+			}
+			inline Float4 ZWXY(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2));
+			}
+			inline Float4 YXWZ(Float4 a) {
+				return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			}
+			// x*x + y*y + z*z, ignoring w
+			inline float Dot3(Float4 a, Float4 b) {
+				Float4 m = _mm_mul_ps(a, b);
+				Float4 sum = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+				return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2))));
+			}
+			inline float Dot4(Float4 a, Float4 b) {
+				Float4 m = _mm_mul_ps(a, b);
+				m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+				return _mm_cvtss_f32(_mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2))));
+			}
+			inline Float4 Div(Float4 a, Float4 b) {
+				return _mm_div_ps(a, b);
+			}
+			inline Float4 Min(Float4 a, Float4 b) {
+				return _mm_min_ps(a, b);
+			}
+			inline Float4 Max(Float4 a, Float4 b) {
+				return _mm_max_ps(a, b);
+			}
+			inline Float4 Sqrt(Float4 a) {
+				return _mm_sqrt_ps(a);
+			}
+			inline Float4 Less(Float4 a, Float4 b) {
+				return _mm_cmplt_ps(a, b);
+			}
+			inline Float4 LessEqual(Float4 a, Float4 b) {
+				return _mm_cmple_ps(a, b);
+			}
+			inline Float4 Equal(Float4 a, Float4 b) {
+				return _mm_cmpeq_ps(a, b);
+			}
+			inline Float4 And(Float4 a, Float4 b) {
+				return _mm_and_ps(a, b);
+			}
+			inline Float4 Or(Float4 a, Float4 b) {
+				return _mm_or_ps(a, b);
+			}
+			// mask ? a : b, lane by lane
+			inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+				return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+			}
+			// One bit per lane, x in bit 0
+			inline int Mask(Float4 mask) {
+				return _mm_movemask_ps(mask);
+			}
+#elif defined(NCL_NEON)
+			typedef float32x4_t Float4;
+
+			inline Float4 Set(float x, float y, float z, float w) {
+				float f[4] = { x, y, z, w };
+				return vld1q_f32(f);
+			}
+			inline Float4 Splat(float f) {
+				return vdupq_n_f32(f);
+			}
+			inline Float4 Load(const float* f) {
+				return vld1q_f32(f);
+			}
+			inline void Store(float* f, Float4 a) {
+				vst1q_f32(f, a);
+			}
+			inline Float4 Add(Float4 a, Float4 b) {
+				return vaddq_f32(a, b);
+			}
+			inline Float4 Sub(Float4 a, Float4 b) {
+				return vsubq_f32(a, b);
+			}
+			inline Float4 Mul(Float4 a, Float4 b) {
+				return vmulq_f32(a, b);
+			}
+			template <int i> inline Float4 SplatLane(Float4 a) {
+				return vdupq_n_f32(vgetq_lane_f32(a, i));
+			}
+			inline Float4 YZXW(Float4 a) {
+				float32x2_t low	= vget_low_f32(a);
+				float32x2_t yz	= vext_f32(low, vget_high_f32(a), 1);
+				float32x2_t xw	= vset_lane_f32(vgetq_lane_f32(a, 3), low, 1);
+				return vcombine_f32(yz, xw);
+			}
+			inline Float4 ZXYW(Float4 a) {
+				float32x2_t low	= vget_low_f32(a);
+				float32x2_t zx	= vset_lane_f32(vgetq_lane_f32(a, 0), vget_high_f32(a), 1);
+				float32x2_t yw	= vset_lane_f32(vgetq_lane_f32(a, 3), vext_f32(low, low, 1), 1);
+				return vcombine_f32(zx, yw);
+			}
+			inline Float4 ZWXY(Float4 a) {
+				return vextq_f32(a, a, 2);
+			}
+			inline Float4 YXWZ(Float4 a) {
+				return vrev64q_f32(a);
+			}
+			inline Float4 WZYX(Float4 a) {
+				return vrev64q_f32(vextq_f32(a, a, 2));
+			}
+			inline float Dot3(Float4 a, Float4 b) {
+				Float4 m = vmulq_f32(a, b);
+				return vgetq_lane_f32(m, 0) + vgetq_lane_f32(m, 1) + vgetq_lane_f32(m, 2);
+			}
+			inline float Dot4(Float4 a, Float4 b) {
+				Float4 m = vmulq_f32(a, b);
+				float32x2_t sum = vadd_f32(vget_low_f32(m), vget_high_f32(m));
+				return vget_lane_f32(vpadd_f32(sum, sum), 0);
+			}
+			inline Float4 Div(Float4 a, Float4 b) {
+				return vdivq_f32(a, b);
+			}
+			inline Float4 Min(Float4 a, Float4 b) {
+				return vminq_f32(a, b);
+			}
+			inline Float4 Max(Float4 a, Float4 b) {
+				return vmaxq_f32(a, b);
+			}
+			inline Float4 Sqrt(Float4 a) {
+				return vsqrtq_f32(a);
+			}
+			inline Float4 Less(Float4 a, Float4 b) {
+				return vreinterpretq_f32_u32(vcltq_f32(a, b));
+			}
+			inline Float4 LessEqual(Float4 a, Float4 b) {
+				return vreinterpretq_f32_u32(vcleq_f32(a, b));
+			}
+			inline Float4 Equal(Float4 a, Float4 b) {
+				return vreinterpretq_f32_u32(vceqq_f32(a, b));
+			}
+			inline Float4 And(Float4 a, Float4 b) {
+				return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+			}
+			inline Float4 Or(Float4 a, Float4 b) {
+				return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+			}
+			inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+				return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+			}
+			inline int Mask(Float4 mask) {
+				uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask), 31);
+				return (int)(vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) |
+					(vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3));
+			}
+#else
+			struct Float4 {
+				float v[4];
+			};
+
+			inline Float4 Set(float x, float y, float z, float w) {
+				return Float4{ { x, y, z, w } };
+			}
+			inline Float4 Splat(float f) {
+				return Float4{ { f, f, f, f } };
+			}
+			inline Float4 Load(const float* f) {
+				return Float4{ { f[0], f[1], f[2], f[3] } };
+			}
+			inline void Store(float* f, Float4 a) {
+				f[0] = a.v[0];
+				f[1] = a.v[1];
+				f[2] = a.v[2];
+				f[3] = a.v[3];
+			}
+			inline Float4 Add(Float4 a, Float4 b) {
+				return Float4{ { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+			}
+			inline Float4 Sub(Float4 a, Float4 b) {
+				return Float4{ { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+			}
+			inline Float4 Mul(Float4 a, Float4 b) {
+				return Float4{ { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } };
+			}
+			template <int i> inline Float4 SplatLane(Float4 a) {
+				return Splat(a.v[i]);
+			}
+			inline Float4 YZXW(Float4 a) {
+				return Float4{ { a.v[1], a.v[2], a.v[0], a.v[3] } };
+			}
+			inline Float4 ZXYW(Float4 a) {
+				return Float4{ { a.v[2], a.v[0], a.v[1], a.v[3] } };
+			}
+			inline Float4 WZYX(Float4 a) {
+				return Float4{ { a.v[3], a.v[2], a.v[1], a.v[0] } };
+			}
+			inline Float4 ZWXY(Float4 a) {
+				return Float4{ { a.v[2], a.v[3], a.v[0], a.v[1] } };
+			}
+			inline Float4 YXWZ(Float4 a) {
+				return Float4{ { a.v[1], a.v[0], a.v[3], a.v[2] } };
+			}
+			inline float Dot3(Float4 a, Float4 b) {
+				return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+			}
+			inline float Dot4(Float4 a, Float4 b) {
+				return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3];
+			}
+			inline Float4 Div(Float4 a, Float4 b) {
+				return Float4{ { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } };
+			}
+			inline Float4 Min(Float4 a, Float4 b) {
+				return Float4{ { std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) } };
+			}
+			inline Float4 Max(Float4 a, Float4 b) {
+				return Float4{ { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) } };
+			}
+			inline Float4 Sqrt(Float4 a) {
+				return Float4{ { std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]) } };
+			}
+			// The scalar masks are the same bit patterns the vector ones would be
+			inline float MaskLane(bool b) {
+				uint32_t bits = b ? 0xFFFFFFFFu : 0u;
+				float f;
+				std::memcpy(&f, &bits, sizeof(float));
+				return f;
+			}
+			inline uint32_t LaneBits(float f) {
+				uint32_t bits;
+				std::memcpy(&bits, &f, sizeof(float));
+				return bits;
+			}
+			inline Float4 Less(Float4 a, Float4 b) {
+				return Float4{ { MaskLane(a.v[0] < b.v[0]), MaskLane(a.v[1] < b.v[1]), MaskLane(a.v[2] < b.v[2]), MaskLane(a.v[3] < b.v[3]) } };
+			}
+			inline Float4 LessEqual(Float4 a, Float4 b) {
+				return Float4{ { MaskLane(a.v[0] <= b.v[0]), MaskLane(a.v[1] <= b.v[1]), MaskLane(a.v[2] <= b.v[2]), MaskLane(a.v[3] <= b.v[3]) } };
+			}
+			inline Float4 Equal(Float4 a, Float4 b) {
+				return Float4{ { MaskLane(a.v[0] == b.v[0]), MaskLane(a.v[1] == b.v[1]), MaskLane(a.v[2] == b.v[2]), MaskLane(a.v[3] == b.v[3]) } };
+			}
+			inline Float4 And(Float4 a, Float4 b) {
+				Float4 out;
+				for (int i = 0; i < 4; ++i) {
+					uint32_t bits = LaneBits(a.v[i]) & LaneBits(b.v[i]);
+					std::memcpy(&out.v[i], &bits, sizeof(float));
+				}
+				return out;
+			}
+			inline Float4 Or(Float4 a, Float4 b) {
+				Float4 out;
+				for (int i = 0; i < 4; ++i) {
+					uint32_t bits = LaneBits(a.v[i]) | LaneBits(b.v[i]);
+					std::memcpy(&out.v[i], &bits, sizeof(float));
+				}
+				return out;
+			}
+			inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+				Float4 out;
+				for (int i = 0; i < 4; ++i) {
+					out.v[i] = LaneBits(mask.v[i]) ? a.v[i] : b.v[i];
+				}
+				return out;
+			}
+			inline int Mask(Float4 mask) {
+				int bits = 0;
+				for (int i = 0; i < 4; ++i) {
+					bits |= (LaneBits(mask.v[i]) >> 31) << i;
+				}
+				return bits;
+			}
+#endif
+			// a * b + c
+			inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) {
+				return Add(Mul(a, b), c);
+			}
+
+			// The cross product of the xyz parts - w comes out as 0
+			inline Float4 Cross3(Float4 a, Float4 b) {
+				return Sub(Mul(YZXW(a), ZXYW(b)), Mul(ZXYW(a), YZXW(b)));
+			}
+		}
+	}
+}
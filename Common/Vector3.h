@@ -10,6 +10,7 @@ https://research.ncl.ac.uk/game/
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include "FastMaths.h"
 
 namespace NCL {
 	namespace Maths {
@@ -36,17 +37,20 @@ namespace NCL {
 
 			~Vector3(void) {}
 
+			template <class Policy = DefaultMaths>
 			Vector3 Normalised() const {
 				Vector3 temp(x, y, z);
-				temp.Normalise();
+				temp.Normalise<Policy>();
 				return temp;
 			}
 
+			// Pass PreciseMaths or FastMaths to pick a version regardless of NCL_FAST_MATHS
+			template <class Policy = DefaultMaths>
 			void			Normalise() {
-				float length = Length();
+				float lengthSquared = LengthSquared();
 
-				if (length != 0.0f) {
-					length = 1.0f / length;
+				if (lengthSquared != 0.0f) {
+					float length = Maths::InvSqrt<Policy>(lengthSquared);
 					x = x * length;
 					y = y * length;
 					z = z * length;
@@ -172,5 +176,15 @@ namespace NCL {
 				return o;
 			}
 		};
+
+		// a * b + c, fused into one rounding if the policy allows
+		template <class Policy = DefaultMaths>
+		inline Vector3 MulAdd(const Vector3& a, float b, const Vector3& c) {
+			return Vector3(
+				Maths::MulAdd<Policy>(a.x, b, c.x),
+				Maths::MulAdd<Policy>(a.y, b, c.y),
+				Maths::MulAdd<Policy>(a.z, b, c.z)
+			);
+		}
 	}
-}
+}
\ No newline at end of file